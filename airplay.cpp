@@ -1,16 +1,27 @@
 #include "airplay.hpp"
+#include "async-log.hpp"
+#include "daap.hpp"
 #include <chrono>
-#include <log/log.hpp>
 #include <obs/obs.h>
+#include <obs/util/platform.h>
 
+#include <algorithm>
 #include <assert.h>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
 #include <cstring>
-#include <fstream>
+#include <fcntl.h>
+#include <filesystem>
+#include <map>
+#include <optional>
 #include <signal.h>
 #include <stddef.h>
 #include <string>
 #include <sys/utsname.h>
 #include <unistd.h>
+#include <utility>
 #include <vector>
 
 #include <ifaddrs.h>
@@ -25,12 +36,20 @@
 #include "logger.h"
 #include "raop.h"
 #include "stream.h"
+#include "resource-usage.hpp"
+#include "stream-stats.hpp"
+#include "udp-sockets.hpp"
 
 #define DEFAULT_NAME "OBS"
 #define DEFAULT_DEBUG_LOG false
 #define NTP_TIMEOUT_LIMIT 5
 #define LOWEST_ALLOWED_PORT 1024
 #define HIGHEST_PORT 65535
+#define UDP_STATS_INTERVAL 10
+#define STREAM_STATS_INTERVAL 10
+#define MAX_SILENT_BUFFERS 32
+// an unchanged picture held back by the decoder is output after this long without a new frame
+#define UNCHANGED_REFRESH_MS 250
 
 static std::string server_name = DEFAULT_NAME;
 static unsigned int max_ntp_timeouts = NTP_TIMEOUT_LIMIT;
@@ -83,11 +102,18 @@ static std::string find_mac()
         break;
       }
     }
+    freeifaddrs(ifap);
   }
-  freeifaddrs(ifap);
   return mac;
 }
 
+static auto steady_now_ns() -> int64_t
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+}
+
 #define MULTICAST 0
 #define LOCAL 1
 #define OCTETS 6
@@ -118,6 +144,44 @@ static int parse_hw_addr(std::string str, std::vector<char> &hw_addr)
   return 0;
 }
 
+// the raop library filters its messages before calling log_callback
+static auto raop_log_level(LogLevel level) -> int
+{
+  switch (level)
+  {
+  case LogLevel::debug: return LOGGER_DEBUG;
+  case LogLevel::info: return LOGGER_INFO;
+  case LogLevel::warning: return LOGGER_WARNING;
+  case LogLevel::error: break;
+  }
+  return LOGGER_ERR;
+}
+
+using LogLevels = std::array<LogLevel, static_cast<int>(LogSubsystem::count)>;
+
+// Log levels of every AirPlay source. The AsyncLog filter is process wide, it passes the most
+// verbose level any source asks for per subsystem, the raop servers filter per source on their
+// own.
+static std::mutex sourceLogLevelsMutex;
+static std::map<const void *, LogLevels> sourceLogLevels;
+
+static auto set_source_log_levels(const void *source, std::optional<LogLevels> levels) -> void
+{
+  std::lock_guard<std::mutex> lock(sourceLogLevelsMutex);
+  if (levels)
+    sourceLogLevels[source] = *levels;
+  else
+    sourceLogLevels.erase(source);
+  LogLevels max;
+  max.fill(LogLevel::error);
+  for (const auto &[s, l] : sourceLogLevels)
+    for (auto i = 0U; i < max.size(); ++i)
+      max[i] = std::max(max[i], l[i]);
+  auto &log = AsyncLog::instance();
+  for (auto i = 0U; i < max.size(); ++i)
+    log.setLevel(static_cast<LogSubsystem>(i), max[i]);
+}
+
 auto AirPlay::stop_raop_server() -> int
 {
   if (raop)
@@ -156,12 +220,13 @@ auto AirPlay::start_raop_server(std::vector<char> hw_addr,
   raop_cbs.audio_get_format = audio_get_format;
   raop_cbs.video_report_size = video_report_size;
   raop_cbs.audio_set_metadata = audio_set_metadata;
+  raop_cbs.audio_set_coverart = audio_set_coverart;
 
   /* set max number of connections = 2 */
   raop = raop_init(2, &raop_cbs);
   if (raop == NULL)
   {
-    LOG("Error initializing raop!");
+    ALOG(session, error, "Error initializing raop!");
     return -1;
   }
 
@@ -186,7 +251,7 @@ auto AirPlay::start_raop_server(std::vector<char> hw_addr,
   raop_set_udp_ports(raop, udp);
 
   raop_set_log_callback(raop, log_callback, NULL);
-  raop_set_log_level(raop, debug_log ? RAOP_LOG_DEBUG : LOGGER_INFO);
+  raop_set_log_level(raop, debug_log ? RAOP_LOG_DEBUG : raop_log_level(raopLogLevel));
 
   unsigned short port = raop_get_port(raop);
   raop_start(raop, &port);
@@ -196,7 +261,7 @@ auto AirPlay::start_raop_server(std::vector<char> hw_addr,
   dnssd = dnssd_init(name.c_str(), strlen(name.c_str()), hw_addr.data(), hw_addr.size(), &error);
   if (error)
   {
-    LOG("Could not initialize dnssd library!");
+    ALOG(session, error, "Could not initialize dnssd library!");
     stop_raop_server();
     return -2;
   }
@@ -220,45 +285,64 @@ auto AirPlay::start_raop_server(std::vector<char> hw_addr,
 // Server callbacks
 auto AirPlay::conn_init(void *cls) -> void
 {
-  LOG(__func__);
+  ALOG(session, debug, __func__);
 
   auto self = static_cast<AirPlay *>(cls);
-  self->open_connections++;
-  self->connections_stopped = false;
-  LOG("Open connections:", self->open_connections);
+  const auto connections = self->session.connect();
+  if (connections == 1)
+  {
+    self->connectTime = steady_now_ns();
+    self->firstPacketTime = 0;
+    ++self->sessions;
+    // a decoder released while idle is reopened on the video thread by video_report_size(), the
+    // callbacks never wait for each other
+    self->vDecoder.resetUnchangedFrames();
+    self->decimatedFrames = 0;
+  }
+  self->idleSince = 0;
+  self->udpSocketsTuned = false;
+  ALOG(session, info, "Open connections:", connections);
 }
 
 auto AirPlay::conn_destroy(void *cls) -> void
 {
-  LOG(__func__);
+  ALOG(session, debug, __func__);
   auto self = static_cast<AirPlay *>(cls);
   // video_renderer_update_background(-1);
-  self->open_connections--;
-  LOG("Open connections:", self->open_connections);
-  if (!self->open_connections)
+  // a restart in progress keeps its state, it sets idle once the new server is up
+  const auto [connections, ended] = self->session.disconnect();
+  ALOG(session, info, "Open connections:", connections);
+  if (ended)
   {
-    self->connections_stopped = true;
+    self->idleSince = steady_now_ns();
+    self->sessionEnded = true;
   }
 }
 
 auto AirPlay::conn_reset(void *cls, int timeouts, bool reset_video) -> void
 {
   auto self = static_cast<AirPlay *>(cls);
-  LOG("***ERROR lost connection with client (network problem?)");
+  ALOG(session, error, "***ERROR lost connection with client (network problem?)");
   if (timeouts)
   {
-    LOG("   Client no-response limit of %d timeouts (%d seconds) reached:", timeouts, 3 * timeouts);
-    LOG("   Sometimes the network connection may recover after a longer delay:\n"
-        "   the default timeout limit n = %d can be changed with the \"-reset n\" option",
-        NTP_TIMEOUT_LIMIT);
+    ALOG(session,
+         error,
+         "   Client no-response limit of",
+         timeouts,
+         "timeouts (",
+         3 * timeouts,
+         "seconds) reached, default limit is",
+         NTP_TIMEOUT_LIMIT);
   }
-  LOG("reset_video", reset_video);
+  ALOG(session, info, "reset_video", reset_video);
+  self->aDecoder.flush();
+  self->vDecoder.flush();
   raop_stop(self->raop);
 }
 
 auto AirPlay::conn_teardown(void * /*cls*/, bool *teardown_96, bool *teardown_110) -> void
 {
-  LOG(__func__, *teardown_96, *teardown_110);
+  ALOG(session, debug, __func__, *teardown_96, *teardown_110);
 }
 
 auto AirPlay::audio_process(void *cls, raop_ntp_t * /*ntp*/, audio_decode_struct *data) -> void
@@ -273,47 +357,70 @@ auto AirPlay::video_process(void *cls, raop_ntp_t * /*ntp*/, h264_decode_struct
   self->render(data);
 }
 
-auto AirPlay::audio_flush(void * /*cls*/) -> void
+auto AirPlay::audio_flush(void *cls) -> void
 {
-  LOG(__func__);
+  ALOG(session, debug, __func__);
+  auto self = static_cast<AirPlay *>(cls);
+  self->aDecoder.flush();
+}
+
+auto AirPlay::video_flush(void *cls) -> void
+{
+  ALOG(session, debug, __func__);
+  auto self = static_cast<AirPlay *>(cls);
+  self->vDecoder.flush();
 }
 
-auto AirPlay::video_flush(void * /*cls*/) -> void
+auto AirPlay::audio_set_volume(void *cls, float volume) -> void
 {
-  LOG(__func__);
+  ALOG(session, debug, __func__, volume);
+  auto self = static_cast<AirPlay *>(cls);
+  self->pcm.setVolume(volume);
 }
 
-auto AirPlay::audio_set_volume(void * /*cls*/, float volume) -> void
+// ct and audioFormat as sent by the client in the RTSP SETUP request
+static auto negotiatedAudioFormat(unsigned char ct, uint64_t audioFormat) -> AudioFormat
 {
-  LOG(__func__, volume);
+  switch (ct)
+  {
+  case 2: return {AudioCodec::alac, 44100, 2};
+  case 4: return {AudioCodec::aacLc, audioFormat & 0x800000 ? 48000 : 44100, 2};
+  case 8:
+    if (audioFormat & 0x2000000)
+      return {AudioCodec::aacEld, 48000, 2};
+    if (audioFormat & 0x4000000)
+      return {AudioCodec::aacEld, 16000, 1};
+    if (audioFormat & 0x8000000)
+      return {AudioCodec::aacEld, 24000, 1};
+    return {AudioCodec::aacEld, 44100, 2};
+  }
+  return {AudioCodec::unsupported, 44100, 2};
 }
 
-auto AirPlay::audio_get_format(void * /*cls*/,
+auto AirPlay::audio_get_format(void *cls,
                                unsigned char *ct,
                                unsigned short *spf,
                                bool *usingScreen,
                                bool *isMedia,
                                uint64_t *audioFormat) -> void
 {
-  unsigned char type;
+  auto self = static_cast<AirPlay *>(cls);
+  ALOG(audio,
+       info,
+       "ct=",
+       static_cast<int>(*ct),
+       "spf=",
+       *spf,
+       "usingScreen=",
+       *usingScreen,
+       "isMedia=",
+       *isMedia,
+       "audioFormat=",
+       (unsigned long)*audioFormat);
+  const auto format = negotiatedAudioFormat(*ct, *audioFormat);
+  if (!self->aDecoder.setFormat(format))
+    ALOG(audio, warning, "audio will not be decoded for this session");
   *ct = 1;
-  LOG("ct=",
-      static_cast<int>(*ct),
-      "spf=",
-      *spf,
-      "usingScreen=",
-      *usingScreen,
-      "isMedia=",
-      *isMedia,
-      "audioFormat=",
-      (unsigned long)*audioFormat);
-  switch (*ct)
-  {
-  case 2: type = 0x20; break;
-  case 8: type = 0x80; break;
-  default: type = 0x10; break;
-  }
-  (void)type;
 }
 
 auto AirPlay::video_report_size(void *cls,
@@ -323,65 +430,167 @@ auto AirPlay::video_report_size(void *cls,
                                 float *height) -> void
 {
   auto self = static_cast<AirPlay *>(cls);
-  LOG("video_report_size:", *width_source, *height_source, *width, *height);
-  self->width = *width_source;
-  self->height = *height_source;
+  ALOG(video, info, "video_report_size:", *width_source, *height_source, *width, *height);
+  self->width = std::lround(*width_source);
+  self->height = std::lround(*height_source);
+
+  // the conversion context and the RGBA plane are set up before the first picture arrives
+  const auto start = steady_now_ns();
+  {
+    std::lock_guard<std::mutex> lock(self->vDecoderMutex);
+    self->vDecoder.prepare(self->width, self->height);
+  }
+  ALOG(video, debug, "Decoder prepared in", (steady_now_ns() - start) / 1'000, "us");
+}
+
+auto AirPlay::audio_set_metadata(void *cls, const void *buffer, int buflen) -> void
+{
+  ALOG(audio, debug, __func__, buflen);
+  auto self = static_cast<AirPlay *>(cls);
+  const auto metadata =
+    parseDaap({static_cast<const uint8_t *>(buffer), static_cast<size_t>(std::max(buflen, 0))});
+  ALOG(audio, info, "Now playing:", metadata.title, "/", metadata.artist, "/", metadata.album);
+  {
+    std::lock_guard<std::mutex> lock(self->nowPlayingMutex);
+    self->nowPlaying.title = metadata.title;
+    self->nowPlaying.artist = metadata.artist;
+    self->nowPlaying.album = metadata.album;
+    self->nowPlaying.composer = metadata.composer;
+    self->nowPlaying.genre = metadata.genre;
+  }
+  self->publish_now_playing();
+}
+
+auto AirPlay::audio_set_coverart(void *cls, const void *buffer, int buflen) -> void
+{
+  ALOG(audio, debug, __func__, buflen);
+  auto self = static_cast<AirPlay *>(cls);
+  if (buflen <= 0)
+    return;
+  const auto data = static_cast<const uint8_t *>(buffer);
+
+  // devices resend the same artwork with every metadata update, FNV-1a tells them apart
+  auto hash = uint64_t{14695981039346656037ULL};
+  for (auto i = 0; i < buflen; ++i)
+    hash = (hash ^ data[i]) * 1099511628211ULL;
+  if (hash == self->coverArtHash)
+    return;
+  self->coverArtHash = hash;
+
+  const auto isPng = buflen >= 4 && memcmp(data, "\x89PNG", 4) == 0;
+  const auto path = self->write_cover_art(data, buflen, isPng ? ".png" : ".jpg");
+  if (path.empty())
+    return;
+  std::string previous;
+  {
+    std::lock_guard<std::mutex> lock(self->nowPlayingMutex);
+    previous = std::exchange(self->nowPlaying.coverArt, path);
+  }
+  if (!previous.empty())
+    unlink(previous.c_str());
+  self->publish_now_playing();
 }
 
-auto AirPlay::audio_set_metadata(void * /*cls*/, const void *buffer, int buflen) -> void
+// The artwork goes into a directory of its own, created with mkdtemp() so only this user can
+// reach it, as a new file per image. O_EXCL and O_NOFOLLOW refuse a file or a symlink planted
+// under the name. Returns the path, empty on failure.
+auto AirPlay::write_cover_art(const uint8_t *data, int len, const char *extension) -> std::string
 {
-  LOG(__func__, buflen);
-  unsigned char mark[] = {0x00, 0x00, 0x00}; /*daap seperator mark */
-  if (buflen > 4)
+  if (coverArtDir.empty())
   {
-    LOG("==============Audio Metadata=============");
-    const unsigned char *metadata = (const unsigned char *)buffer;
-    const char *tag = (const char *)buffer;
-    int len;
-    metadata += 4;
-    for (int i = 4; i < buflen; i++)
+    auto dir = (std::filesystem::temp_directory_path() / "obs-airplay-XXXXXX").string();
+    if (!mkdtemp(dir.data()))
     {
-      if (memcmp(metadata, mark, 3) == 0 && (len = (int)*(metadata + 3)))
-      {
-        bool found_text = true;
-        if (strcmp(tag, "asal") == 0)
-        {
-          LOG("Album: ");
-        }
-        else if (strcmp(tag, "asar") == 0)
-        {
-          LOG("Artist: ");
-        }
-        else if (strcmp(tag, "ascp") == 0)
-        {
-          LOG("Composer: ");
-        }
-        else if (strcmp(tag, "asgn") == 0)
-        {
-          LOG("Genre: ");
-        }
-        else if (strcmp(tag, "minm") == 0)
-        {
-          LOG("Title: ");
-        }
-        else
-        {
-          found_text = false;
-        }
-        if (found_text)
-        {
-          const unsigned char *text = metadata + 4;
-          for (int j = 0; j < len; j++)
-          {
-            LOG(*text);
-            text++;
-          }
-        }
-      }
-      metadata++;
-      tag++;
+      ALOG(audio, warning, "Could not create a directory for the cover art:", strerror(errno));
+      return {};
     }
+    coverArtDir = dir;
+  }
+  const auto path = coverArtDir + "/cover-" + std::to_string(++coverArtFiles) + extension;
+  const auto fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+  if (fd < 0)
+  {
+    ALOG(audio, warning, "Could not create", path, strerror(errno));
+    return {};
+  }
+  auto written = 0;
+  while (written < len)
+  {
+    const auto n = write(fd, data + written, len - written);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    written += n;
+  }
+  close(fd);
+  if (written < len)
+  {
+    ALOG(audio, warning, "Could not write cover art to", path, strerror(errno));
+    unlink(path.c_str());
+    return {};
+  }
+  return path;
+}
+
+auto AirPlay::publish_now_playing() -> void
+{
+  if (!obsSource)
+    return;
+  // the strings have no size limit, a fixed buffer would truncate or overflow
+  calldata_t cd;
+  calldata_init(&cd);
+  calldata_set_ptr(&cd, "source", obsSource);
+  {
+    std::lock_guard<std::mutex> lock(nowPlayingMutex);
+    calldata_set_string(&cd, "title", nowPlaying.title.c_str());
+    calldata_set_string(&cd, "artist", nowPlaying.artist.c_str());
+    calldata_set_string(&cd, "album", nowPlaying.album.c_str());
+    calldata_set_string(&cd, "composer", nowPlaying.composer.c_str());
+    calldata_set_string(&cd, "genre", nowPlaying.genre.c_str());
+    calldata_set_string(&cd, "cover_art", nowPlaying.coverArt.c_str());
+  }
+  signal_handler_signal(obs_source_get_signal_handler(obsSource), "now_playing", &cd);
+  calldata_free(&cd);
+}
+
+auto AirPlay::get_now_playing(void *data, calldata_t *cd) -> void
+{
+  auto self = static_cast<AirPlay *>(data);
+  std::lock_guard<std::mutex> lock(self->nowPlayingMutex);
+  calldata_set_string(cd, "title", self->nowPlaying.title.c_str());
+  calldata_set_string(cd, "artist", self->nowPlaying.artist.c_str());
+  calldata_set_string(cd, "album", self->nowPlaying.album.c_str());
+  calldata_set_string(cd, "composer", self->nowPlaying.composer.c_str());
+  calldata_set_string(cd, "genre", self->nowPlaying.genre.c_str());
+  calldata_set_string(cd, "cover_art", self->nowPlaying.coverArt.c_str());
+}
+
+// UDP counters as sampled by the last report_udp_stats(), stream and decoder figures of the last
+// stream report
+auto AirPlay::get_stats(void *data, calldata_t *cd) -> void
+{
+  auto self = static_cast<AirPlay *>(data);
+  calldata_set_int(cd, "sessions", self->sessions);
+  calldata_set_int(cd, "udp_drops", self->udpDrops);
+  calldata_set_int(cd, "udp_rx_queue", self->udpRxQueue);
+  StreamReport r;
+  {
+    std::lock_guard<std::mutex> lock(self->vDecoderMutex);
+    r = self->streamStats.lastReport();
   }
+  calldata_set_string(cd, "codec", r.codec == VideoCodec::hevc ? "HEVC" : "H.264");
+  calldata_set_int(cd, "kbps", r.kbps);
+  calldata_set_float(cd, "fps", r.fps);
+  calldata_set_int(cd, "max_packet", r.maxPacket);
+  calldata_set_int(cd, "idr_frames", r.idrFrames);
+  calldata_set_int(cd, "gop", r.gop);
+  calldata_set_int(cd, "sps_changes", r.spsChanges);
+  calldata_set_int(cd, "decodes", r.decodes);
+  calldata_set_int(cd, "decode_avg_us", r.decodeAvgUs);
+  calldata_set_int(cd, "decode_max_us", r.decodeMaxUs);
+  calldata_set_int(cd, "refreshes", r.refreshes);
+  calldata_set_int(cd, "refresh_avg_us", r.refreshAvgUs);
 }
 
 auto AirPlay::log_callback(void * /*cls*/, int level, const char *msg) -> void
@@ -389,19 +598,19 @@ auto AirPlay::log_callback(void * /*cls*/, int level, const char *msg) -> void
   switch (level)
   {
   case LOGGER_DEBUG: {
-    LOG("D", msg);
+    ALOG(raop, debug, msg);
     break;
   }
   case LOGGER_WARNING: {
-    LOG("W", msg);
+    ALOG(raop, warning, msg);
     break;
   }
   case LOGGER_INFO: {
-    LOG("I", msg);
+    ALOG(raop, info, msg);
     break;
   }
   case LOGGER_ERR: {
-    LOG("E", msg);
+    ALOG(raop, error, msg);
     break;
   }
   default: break;
@@ -414,10 +623,41 @@ AirPlay::AirPlay(struct obs_data *obsData, struct obs_source *obsSource)
     obsVFrame(std::make_unique<obs_source_frame>()),
     obsAFrame(std::make_unique<obs_source_audio>())
 {
+  if (obsSource)
+  {
+    signal_handler_add(obs_source_get_signal_handler(obsSource),
+                       "void now_playing(ptr source, string title, string artist, string album, "
+                       "string composer, string genre, string cover_art)");
+    proc_handler_add(obs_source_get_proc_handler(obsSource),
+                     "void get_now_playing(out string title, out string artist, out string album, "
+                     "out string composer, out string genre, out string cover_art)",
+                     get_now_playing,
+                     this);
+    proc_handler_add(obs_source_get_proc_handler(obsSource),
+                     "void get_stats(out int sessions, out int udp_drops, out int udp_rx_queue, "
+                     "out string codec, out int kbps, out float fps, out int max_packet, "
+                     "out int idr_frames, out int gop, out int sps_changes, out int decodes, "
+                     "out int decode_avg_us, out int decode_max_us, out int refreshes, "
+                     "out int refresh_avg_us)",
+                     get_stats,
+                     this);
+  }
+
   // Get settings from obs_data
   const char* name_setting = obs_data_get_string(obsData, "server_name");
   current_server_name = (name_setting && strlen(name_setting) > 0) ? name_setting : "OBS";
   current_use_random_mac = obs_data_get_bool(obsData, "use_random_mac");
+  idleReleaseDelay = obs_data_get_int(obsData, "idle_release_delay");
+  networkPort = obs_data_get_int(obsData, "network_port");
+  udpReceiveBuffer = obs_data_get_int(obsData, "udp_receive_buffer");
+  apply_log_levels(obsData);
+  set_low_latency(obs_data_get_bool(obsData, "low_latency"));
+  maxOutputSize = obs_data_get_int(obsData, "max_output_size");
+  update_max_output_size();
+  update_frame_interval();
+  set_frame_export(obsData);
+  set_thread_policy(obsData);
+  refreshThread = std::thread(&AirPlay::refresh_loop, this);
   
   // Initialize pending settings to current
   pending_server_name = current_server_name;
@@ -427,6 +667,7 @@ AirPlay::AirPlay(struct obs_data *obsData, struct obs_source *obsSource)
   std::vector<char> server_hw_addr;
   bool debug_log = DEFAULT_DEBUG_LOG;
   unsigned short tcp[3] = {0}, udp[3] = {0};
+  network_ports(tcp, udp);
 
 #ifdef SUPPRESS_AVAHI_COMPAT_WARNING
   // suppress avahi_compat nag message.  avahi emits a "nag" warning (once)
@@ -437,7 +678,16 @@ AirPlay::AirPlay(struct obs_data *obsData, struct obs_source *obsSource)
 #endif
 
   if (udp[0])
-    LOG("using network ports UDP", udp[0], udp[1], udp[2], "TCP", tcp[0], tcp[1], tcp[2]);
+    ALOG(session,
+         info,
+         "using network ports UDP",
+         udp[0],
+         udp[1],
+         udp[2],
+         "TCP",
+         tcp[0],
+         tcp[1],
+         tcp[2]);
 
   std::string mac_address;
   if (!current_use_random_mac)
@@ -446,24 +696,29 @@ AirPlay::AirPlay(struct obs_data *obsData, struct obs_source *obsSource)
   {
     srand(time(NULL) * getpid());
     mac_address = random_mac();
-    LOG("using randomly-generated MAC address", mac_address);
+    ALOG(session, info, "using randomly-generated MAC address", mac_address);
   }
   else
   {
-    LOG("using system MAC address", mac_address);
+    ALOG(session, info, "using system MAC address", mac_address);
   }
   parse_hw_addr(mac_address, server_hw_addr);
   mac_address.clear();
 
-  connections_stopped = true;
+  idleSince = steady_now_ns();
+  counter = 0;
+  compression_type = 0;
 
+  // raop accepts connections before start_raop_server() returns, conn_init has to find the
+  // server idle by then
+  session.set(SessionState::idle);
   if (start_raop_server(server_hw_addr, current_server_name, tcp, udp, debug_log) != 0)
   {
-    LOG("start_raop_server failed");
+    ALOG(session, error, "start_raop_server failed");
+    session.set(SessionState::stopped);
     return;
   }
-  counter = 0;
-  compression_type = 0;
+  baselineUsage = resourceUsage();
 }
 
 auto AirPlay::update(struct obs_data *data) -> void
@@ -471,6 +726,15 @@ auto AirPlay::update(struct obs_data *data) -> void
   const char* name_setting = obs_data_get_string(data, "server_name");
   std::string new_server_name = (name_setting && strlen(name_setting) > 0) ? name_setting : "OBS";
   bool new_use_random_mac = obs_data_get_bool(data, "use_random_mac");
+  idleReleaseDelay = obs_data_get_int(data, "idle_release_delay");
+  udpReceiveBuffer = obs_data_get_int(data, "udp_receive_buffer");
+  const int new_network_port = obs_data_get_int(data, "network_port");
+  apply_log_levels(data);
+  set_low_latency(obs_data_get_bool(data, "low_latency"));
+  maxOutputSize = obs_data_get_int(data, "max_output_size");
+  update_max_output_size();
+  set_frame_export(data);
+  set_thread_policy(data);
   
   // Update pending settings
   pending_server_name = new_server_name;
@@ -480,9 +744,16 @@ auto AirPlay::update(struct obs_data *data) -> void
   // Server name changes are stored but not applied until button is clicked
   if (new_use_random_mac != current_use_random_mac)
   {
-    LOG("MAC address setting changed, restarting server...");
+    ALOG(session, info, "MAC address setting changed, restarting server...");
+    networkPort = new_network_port;
     restart_server_with_settings(current_server_name, new_use_random_mac);
   }
+  else if (new_network_port != networkPort)
+  {
+    ALOG(session, info, "Network port setting changed, restarting server...");
+    networkPort = new_network_port;
+    restart_server_with_settings(current_server_name, current_use_random_mac);
+  }
   
   // Track if server name has changed
   settings_changed = (pending_server_name != current_server_name);
@@ -490,10 +761,14 @@ auto AirPlay::update(struct obs_data *data) -> void
 
 auto AirPlay::restart_server_with_settings(const std::string& name, bool use_random_mac) -> void
 {
-  LOG("Restarting AirPlay server...");
+  ALOG(session, info, "Restarting AirPlay server...");
   
-  // Stop current server
+  // Stop current server, raop_destroy() joins the callback threads, packets still in flight are
+  // dropped by render() until the new server is up
+  session.set(SessionState::restarting);
   stop_raop_server();
+  session.set(SessionState::restarting, true);
+  sessions = 0;
   
   // Update current settings
   current_server_name = name;
@@ -504,6 +779,7 @@ auto AirPlay::restart_server_with_settings(const std::string& name, bool use_ran
   std::vector<char> server_hw_addr;
   bool debug_log = DEFAULT_DEBUG_LOG;
   unsigned short tcp[3] = {0}, udp[3] = {0};
+  network_ports(tcp, udp);
   
   std::string mac_address;
   if (!current_use_random_mac)
@@ -512,40 +788,445 @@ auto AirPlay::restart_server_with_settings(const std::string& name, bool use_ran
   {
     srand(time(NULL) * getpid());
     mac_address = random_mac();
-    LOG("using randomly-generated MAC address", mac_address);
+    ALOG(session, info, "using randomly-generated MAC address", mac_address);
   }
   else
   {
-    LOG("using system MAC address", mac_address);
+    ALOG(session, info, "using system MAC address", mac_address);
   }
   parse_hw_addr(mac_address, server_hw_addr);
   
+  // set before the server starts, a device may connect before start_raop_server() returns
+  idleSince = steady_now_ns();
+  session.set(SessionState::idle);
   if (start_raop_server(server_hw_addr, current_server_name, tcp, udp, debug_log) != 0)
   {
-    LOG("start_raop_server failed after settings update");
+    ALOG(session, error, "start_raop_server failed after settings update");
+    session.set(SessionState::stopped);
+    return;
+  }
+  log_resource_usage("after server restart");
+}
+
+auto AirPlay::network_ports(unsigned short tcp[3], unsigned short udp[3]) -> void
+{
+  // same layout as UxPlay's -p option: TCP and UDP ports n, n+1, n+2
+  for (auto i = 0; i < 3; ++i)
+  {
+    const auto port = networkPort >= LOWEST_ALLOWED_PORT && networkPort + 2 <= HIGHEST_PORT
+                         ? static_cast<unsigned short>(networkPort + i)
+                         : 0;
+    tcp[i] = port;
+    udp[i] = port;
+  }
+  {
+    std::lock_guard<std::mutex> lock(udpMutex);
+    std::copy(udp, udp + 3, udpPorts.begin());
+  }
+  if (networkPort && !udp[0])
+    ALOG(session, warning, "network port", networkPort, "is out of range, using dynamic ports");
+}
+
+// network_ports() sets them on the UI thread, the audio thread and tick() read a copy
+auto AirPlay::udp_ports() -> std::array<unsigned short, 3>
+{
+  std::lock_guard<std::mutex> lock(udpMutex);
+  return udpPorts;
+}
+
+auto AirPlay::tune_udp_sockets() -> void
+{
+  if (udpReceiveBuffer <= 0)
+    return;
+  const auto ports = udp_ports();
+  if (!ports[0])
+  {
+    ALOG(session,
+         warning,
+         "UDP receive buffer size needs a fixed network port, keeping the system default");
+    return;
+  }
+  if (setUdpReceiveBuffer(ports, udpReceiveBuffer * 1024) == 0)
+    ALOG(session, warning, "No UDP sockets found on ports", ports[0], ports[1], ports[2]);
+}
+
+// Logs a port only when its drop counter grew since the last report, with the increase. A
+// restarted server has new sockets whose counters start over.
+auto AirPlay::report_udp_stats() -> void
+{
+  const auto ports = udp_ports();
+  if (!ports[0] || session.state() != SessionState::connected)
+    return;
+  const auto now = steady_now_ns();
+  if (now - lastUdpStats < UDP_STATS_INTERVAL * 1'000'000'000LL)
+    return;
+  lastUdpStats = now;
+  // a port may have an IPv4 and an IPv6 socket
+  std::array<long, 3> drops = {}, rxQueue = {};
+  for (const auto &s : udpSocketStats(ports))
+  {
+    const auto i = std::find(ports.begin(), ports.end(), s.port) - ports.begin();
+    drops[i] += s.drops;
+    rxQueue[i] += s.rxQueue;
+  }
+  for (auto i = 0U; i < ports.size(); ++i)
+  {
+    auto &previous = udpPortDrops[i];
+    const auto grown = drops[i] < previous ? drops[i] : drops[i] - previous;
+    previous = drops[i];
+    if (grown > 0)
+      ALOG(session,
+           warning,
+           "UDP port",
+           ports[i],
+           "dropped",
+           grown,
+           "datagrams since the last report, rx queue:",
+           rxQueue[i]);
   }
+  udpDrops = drops[0] + drops[1] + drops[2];
+  udpRxQueue = rxQueue[0] + rxQueue[1] + rxQueue[2];
+}
+
+auto AirPlay::apply_log_levels(struct obs_data *data) -> void
+{
+  auto level = [](long long v) {
+    return static_cast<LogLevel>(std::clamp(v, 0LL, static_cast<long long>(LogLevel::debug)));
+  };
+  // settings saved before the levels were split keep their single plugin level
+  auto plugin = [&](const char *name) {
+    if (!obs_data_has_user_value(data, name) && obs_data_has_user_value(data, "log_level"))
+      return level(obs_data_get_int(data, "log_level"));
+    return level(obs_data_get_int(data, name));
+  };
+  raopLogLevel = level(obs_data_get_int(data, "raop_log_level"));
+  LogLevels levels;
+  levels[static_cast<int>(LogSubsystem::raop)] = raopLogLevel;
+  levels[static_cast<int>(LogSubsystem::session)] = plugin("log_level_session");
+  levels[static_cast<int>(LogSubsystem::video)] = plugin("log_level_video");
+  levels[static_cast<int>(LogSubsystem::audio)] = plugin("log_level_audio");
+  set_source_log_levels(this, levels);
+  // takes effect on the running server, no restart needed
+  if (raop)
+    raop_set_log_level(raop, raop_log_level(raopLogLevel));
+}
+
+auto AirPlay::set_low_latency(bool value) -> void
+{
+  if (lowLatency.exchange(value) == value)
+    return;
+  clockOffset = 0;
+  if (obsSource)
+    obs_source_set_async_unbuffered(obsSource, value);
+  ALOG(video,
+       info,
+       value ? "Low latency mode: frames are shown on arrival" : "Low latency mode off");
+}
+
+auto AirPlay::update_max_output_size() -> void
+{
+  const auto size = maxOutputSize.load();
+  if (size == MaxOutputCanvas)
+  {
+    obs_video_info ovi;
+    if (obs_get_video_info(&ovi))
+      vDecoder.setMaxOutputSize(ovi.base_width, ovi.base_height);
+    return;
+  }
+  vDecoder.setMaxOutputSize(size * 16 / 9, size);
+}
+
+// "/obs-airplay-<source name>", OBS source names are unique, so two sources never share a segment
+// by default. Characters other than letters, digits, '-' and '_' become '_'.
+auto AirPlay::default_frame_export_name() const -> std::string
+{
+  const auto sourceName = obsSource ? obs_source_get_name(obsSource) : nullptr;
+  std::string ret = "/obs-airplay-";
+  if (!sourceName || !*sourceName)
+    return ret + std::to_string(getpid());
+  for (auto p = sourceName; *p; ++p)
+    ret += isalnum(static_cast<unsigned char>(*p)) || *p == '-' || *p == '_' ? *p : '_';
+  return ret;
+}
+
+auto AirPlay::set_frame_export(struct obs_data *data) -> void
+{
+  const auto enabled = obs_data_get_bool(data, "frame_export");
+  const auto name = obs_data_get_string(data, "frame_export_name");
+  std::string shmName = name && *name ? name : default_frame_export_name();
+  if (shmName[0] != '/')
+    shmName = "/" + shmName;
+
+  std::lock_guard<std::mutex> lock(vDecoderMutex);
+  if (!enabled)
+  {
+    if (frameExport)
+      ALOG(video, info, "Frame export to", frameExport->name(), "stopped");
+    frameExport.reset();
+    return;
+  }
+  if (frameExport && frameExport->name() == shmName)
+    return;
+  // the segment is created with the first frame, once its size is known
+  frameExport = std::make_unique<ShmFrameWriter>(shmName);
+  ALOG(video, info, "Exporting decoded frames to shared memory", shmName);
+}
+
+auto AirPlay::update_frame_interval() -> void
+{
+  obs_video_info ovi;
+  if (obs_get_video_info(&ovi) && ovi.fps_num)
+    frameInterval = 1'000'000'000LL * ovi.fps_den / ovi.fps_num;
+}
+
+// Called by render() with vDecoderMutex held. A picture the decoder held back is refreshed when
+// nothing replaced it: a decimated one once no packet followed within an OBS frame interval, it
+// ended a burst and would never be shown otherwise, an unchanged one once no new frame came for a
+// while, in case a change fell between the hashed rows.
+auto AirPlay::schedule_refresh(int64_t arrival) -> void
+{
+  if (!vDecoder.pending())
+    refreshDeadline = 0;
+  else
+    refreshDeadline = pendingDecimated ? arrival + frameInterval
+                                       : lastOutputTime + UNCHANGED_REFRESH_MS * 1'000'000LL;
+  refreshCv.notify_one();
+}
+
+// Waits for the refresh deadline set by render(), the conversion runs here rather than on the
+// OBS graphics thread. A packet arriving first moves or clears the deadline.
+auto AirPlay::refresh_loop() -> void
+{
+  std::unique_lock<std::mutex> lock(vDecoderMutex);
+  while (!refreshStop)
+  {
+    apply_thread_policy("airplay-refresh");
+    const auto deadline = refreshDeadline;
+    if (!deadline)
+    {
+      refreshCv.wait(lock);
+      continue;
+    }
+    const auto due = std::chrono::steady_clock::time_point{std::chrono::nanoseconds{deadline}};
+    const auto moved = [&]() { return refreshStop || refreshDeadline != deadline; };
+    if (refreshCv.wait_until(lock, due, moved))
+      continue;
+    output_pending();
+  }
+}
+
+// Called with vDecoderMutex held
+auto AirPlay::output_pending() -> void
+{
+  refreshDeadline = 0;
+  if (session.state() != SessionState::connected || !vDecoder.pending())
+    return;
+  const auto start = steady_now_ns();
+  const auto vFrame = vDecoder.convertPending();
+  streamStats.refreshTime(steady_now_ns() - start);
+  if (!vFrame)
+    return;
+  if (pendingDecimated)
+    --decimatedFrames;
+  output_video(vFrame, pendingPts);
+}
+
+// Frames whose pts falls before the next tick of the OBS frame rate would be dropped by OBS
+// anyway. A quarter interval of slack keeps senders running at the canvas rate from losing
+// frames to jitter.
+auto AirPlay::on_output_cadence(uint64_t pts) -> bool
+{
+  const auto interval = frameInterval.load();
+  const auto t = static_cast<int64_t>(pts * 1'000);
+  if (interval <= 0)
+    return true;
+  if (t < nextFramePts - interval / 4 && nextFramePts - t < 2 * interval)
+  {
+    ++decimatedFrames;
+    return false;
+  }
+  // resync after a stall or when the pts jumps backwards instead of catching up frame by frame
+  nextFramePts = std::abs(t - nextFramePts) > 2 * interval ? t + interval : nextFramePts + interval;
+  return true;
+}
+
+auto AirPlay::set_thread_policy(struct obs_data *data) -> void
+{
+  ThreadPolicy policy;
+  const auto cpus = obs_data_get_string(data, "thread_cpus");
+  policy.cpus = parseCpuList(cpus ? cpus : "");
+  policy.priority = static_cast<ThreadPriority>(std::clamp(
+    obs_data_get_int(data, "thread_priority"), 0LL, static_cast<long long>(ThreadPriority::realtime)));
+  std::lock_guard<std::mutex> lock(threadPolicyMutex);
+  if (policy.cpus == threadPolicy.cpus && policy.priority == threadPolicy.priority)
+    return;
+  threadPolicy = std::move(policy);
+  ++threadPolicyGeneration;
+}
+
+// Called on the receive threads, the decoders are single threaded and decode on them
+auto AirPlay::apply_thread_policy(const char *name) -> void
+{
+  thread_local int appliedGeneration = 0;
+  // a thread that never ran with a policy already has the default one
+  thread_local bool customized = false;
+  const auto generation = threadPolicyGeneration.load();
+  if (appliedGeneration == generation)
+    return;
+  appliedGeneration = generation;
+  ThreadPolicy policy;
+  {
+    std::lock_guard<std::mutex> lock(threadPolicyMutex);
+    policy = threadPolicy;
+  }
+  if (policy.isDefault() && !customized)
+  {
+    nameThread(name);
+    return;
+  }
+  customized = !policy.isDefault();
+  if (!applyThreadPolicy(name, policy))
+    ALOG(session, warning, name, "runs without the requested thread policy");
+}
+
+auto AirPlay::log_resource_usage(const char *when) const -> void
+{
+  const auto usage = resourceUsage();
+  ALOG(session,
+       info,
+       "Resources",
+       when,
+       "- RSS",
+       usage.rss / 1024,
+       "KiB (",
+       (usage.rss - baselineUsage.rss) / 1024,
+       "), fds",
+       usage.fds,
+       "(",
+       usage.fds - baselineUsage.fds,
+       "), threads",
+       usage.threads,
+       "(",
+       usage.threads - baselineUsage.threads,
+       ") relative to source creation");
 }
 
 auto AirPlay::apply_settings() -> void
 {
   if (!settings_changed)
   {
-    LOG("No server name changes to apply");
+    ALOG(session, info, "No server name changes to apply");
     return;
   }
     
-  LOG("Applying server name change...");
+  ALOG(session, info, "Applying server name change...");
   restart_server_with_settings(pending_server_name, current_use_random_mac);
 }
 
-auto AirPlay::render(const h264_decode_struct *pkt) -> void
+auto AirPlay::tick() -> void
 {
-  if (!obsSource)
+  report_udp_stats();
+  // follows canvas size and frame rate changes made while a device is mirroring
+  if (maxOutputSize == MaxOutputCanvas)
+    update_max_output_size();
+  update_frame_interval();
+
+  if (sessionEnded.exchange(false))
+  {
+    ALOG(video,
+         info,
+         "Unchanged frames not converted or output this session:",
+         vDecoder.unchangedFrames());
+    ALOG(video,
+         info,
+         "Frames decimated to the OBS frame rate this session:",
+         decimatedFrames.load());
+    log_resource_usage("at session end");
+  }
+
+  auto since = idleSince.load();
+  if (!since || idleReleaseDelay <= 0)
+    return;
+  if (steady_now_ns() - since < idleReleaseDelay * 1'000'000'000LL)
+    return;
+  // a device connecting meanwhile clears idleSince, the decoder is then rebuilt on its first packet
+  if (!idleSince.compare_exchange_strong(since, 0))
     return;
 
-  auto vFrame = vDecoder.decode({pkt->data, pkt->data + pkt->data_len});
-  if (!vFrame)
+  const auto rssBefore = resourceUsage().rss;
+  {
+    std::lock_guard<std::mutex> lock(vDecoderMutex);
+    vDecoder.release();
+  }
+  ALOG(session,
+       info,
+       "No device connected for",
+       idleReleaseDelay.load(),
+       "s, released decoder memory, RSS",
+       rssBefore / 1024,
+       "KiB ->",
+       resourceUsage().rss / 1024,
+       "KiB");
+}
+
+auto AirPlay::render(const h264_decode_struct *pkt) -> void
+{
+  // without a source the picture is still decoded, the tools drive a source-less AirPlay
+  if (session.state() != SessionState::connected)
     return;
+  const auto arrival = steady_now_ns();
+  const auto data = std::span<const uint8_t>{pkt->data, static_cast<size_t>(pkt->data_len)};
+
+  std::lock_guard<std::mutex> lock(vDecoderMutex);
+  apply_thread_policy("airplay-video");
+  if (connectTime && !firstPacketTime)
+  {
+    firstPacketTime = arrival;
+    streamStats.reset();
+  }
+  streamStats.packet(data, arrival);
+  const auto decodeStart = steady_now_ns();
+  const auto convert = on_output_cadence(pkt->pts);
+  auto vFrame = vDecoder.decode(data, convert);
+  const auto decodeEnd = steady_now_ns();
+  streamStats.decodeTime(decodeEnd - decodeStart);
+  streamStats.report(decodeEnd, STREAM_STATS_INTERVAL * 1'000'000'000LL);
+  lastPacketTime = arrival;
+  pendingPts = pkt->pts;
+  pendingDecimated = !convert;
+  if (frameExport && vDecoder.decodedPicture())
+    export_picture(pkt->pts);
+  if (vFrame)
+    output_video(vFrame, pkt->pts);
+  schedule_refresh(arrival);
+}
+
+// Called with vDecoderMutex held. Every decoded picture is exported, whether OBS gets it or it was
+// decimated or unchanged, the consumers pick their own rate.
+auto AirPlay::export_picture(uint64_t pts) -> void
+{
+  const auto yuv = vDecoder.picture();
+  std::array<ShmPlane, 4> planes;
+  for (auto i = 0; i < yuv.planes; ++i)
+    planes[i] = {yuv.data[i], yuv.linesize[i], yuv.rows[i]};
+  // the timestamp OBS would give the frame
+  const auto timestamp = lowLatency ? os_gettime_ns() : pts * 1'000;
+  if (!frameExport->write(yuv.width,
+                          yuv.height,
+                          yuv.format,
+                          {planes.data(), static_cast<size_t>(yuv.planes)},
+                          timestamp,
+                          pts))
+  {
+    ALOG(video, error, "Frame export to", frameExport->name(), "failed:", strerror(errno));
+    frameExport.reset();
+  }
+}
+
+// Called with vDecoderMutex held, pts is the sender's in us
+auto AirPlay::output_video(const VFrame *vFrame, uint64_t pts) -> void
+{
+  lastOutputTime = steady_now_ns();
   obsVFrame->width = vFrame->width;
   obsVFrame->height = vFrame->height;
   obsVFrame->format = vFrame->format;
@@ -562,8 +1243,33 @@ auto AirPlay::render(const h264_decode_struct *pkt) -> void
   }
 
   // set current time in ns
-  obsVFrame->timestamp = pkt->pts * 1'000;
-  obs_source_output_video(obsSource, obsVFrame.get());
+  obsVFrame->timestamp = pts * 1'000;
+  if (lowLatency)
+  {
+    const auto now = os_gettime_ns();
+    clockOffset = static_cast<int64_t>(now - obsVFrame->timestamp);
+    obsVFrame->timestamp = now;
+  }
+  if (obsSource)
+    obs_source_output_video(obsSource, obsVFrame.get());
+
+  if (const auto t = connectTime.exchange(0))
+  {
+    const auto now = steady_now_ns();
+    ALOG(session,
+         info,
+         "Connect to first frame:",
+         (now - t) / 1'000'000,
+         "ms, first packet after",
+         (firstPacketTime - t) / 1'000'000,
+         "ms, first frame",
+         (now - firstPacketTime) / 1'000'000,
+         "ms after that, session",
+         sessions.load(),
+         "since server start, conversion",
+         vDecoder.prewarmed() == VideoDecoder::Prewarm::hit ? "pre-warmed"
+                                                            : "set up on the first frame");
+  }
 }
 
 auto AirPlay::getWidth() const -> int
@@ -583,18 +1289,50 @@ auto AirPlay::name() const -> const char *
 
 AirPlay::~AirPlay()
 {
-  LOG("Stopping...");
+  ALOG(session, info, "Stopping...");
+  session.set(SessionState::stopped);
+  {
+    std::lock_guard<std::mutex> lock(vDecoderMutex);
+    refreshStop = true;
+  }
+  refreshCv.notify_one();
+  refreshThread.join();
   stop_raop_server();
+  log_resource_usage("after server stop");
+  set_source_log_levels(this, std::nullopt);
+  // the callbacks are joined, nothing writes the artwork anymore
+  if (!nowPlaying.coverArt.empty())
+    unlink(nowPlaying.coverArt.c_str());
+  if (!coverArtDir.empty())
+    rmdir(coverArtDir.c_str());
 }
 
 auto AirPlay::render(const audio_decode_struct *pkt) -> void
 {
-  if (!obsSource)
+  if (!obsSource || session.state() != SessionState::connected)
     return;
+  // the sockets exist once the first packet arrives
+  if (!udpSocketsTuned.exchange(true))
+    tune_udp_sockets();
+  apply_thread_policy("airplay-audio");
   auto aFrame = aDecoder.decode({pkt->data, pkt->data + pkt->data_len});
   if (!aFrame)
     return;
 
+  // a short run of silence is still sent so OBS keeps the timing, after that nothing is output
+  // until the sound comes back
+  if (pcm.process(aFrame->data, aFrame->speakers == SPEAKERS_STEREO ? 2 : 1))
+  {
+    if (++silentBuffers > MAX_SILENT_BUFFERS)
+      return;
+  }
+  else if (silentBuffers)
+  {
+    if (silentBuffers > MAX_SILENT_BUFFERS)
+      ALOG(audio, debug, "Skipped", silentBuffers - MAX_SILENT_BUFFERS, "silent buffers");
+    silentBuffers = 0;
+  }
+
   obsAFrame->data[0] = const_cast<uint8_t *>(reinterpret_cast<const uint8_t *>(aFrame->data.data()));
   for (auto i = 1U; i < MAX_AV_PLANES; i++)
     obsAFrame->data[i] = nullptr;
@@ -603,5 +1341,7 @@ auto AirPlay::render(const audio_decode_struct *pkt) -> void
   obsAFrame->samples_per_sec = aFrame->sampleRate;
   // set current time in ns
   obsAFrame->timestamp = pkt->ntp_time * 1'000;
+  if (lowLatency)
+    obsAFrame->timestamp += clockOffset;
   obs_source_output_audio(obsSource, obsAFrame.get());
 }
@@ -1,14 +1,41 @@
 #pragma once
+#include "async-log.hpp"
 #include "audio-decoder.hpp"
-#include "h264-decoder.hpp"
+#include "pcm-processor.hpp"
+#include "resource-usage.hpp"
+#include "session-state.hpp"
+#include "shm-frame-ring.hpp"
+#include "stream-stats.hpp"
+#include "thread-policy.hpp"
+#include "video-decoder.hpp"
+#include <array>
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <stream.h>
 #include <vector>
 #include <string>
 
+struct NowPlaying
+{
+  std::string title;
+  std::string artist;
+  std::string album;
+  std::string composer;
+  std::string genre;
+  // artwork as sent by the device, not decoded, written to a new file per distinct image
+  std::string coverArt;
+};
+
 class AirPlay
 {
 public:
+  // max_output_size value that follows the OBS canvas, other values are the height of a 16:9 box,
+  // 0 keeps the sender's resolution
+  static constexpr auto MaxOutputCanvas = -1;
+
   AirPlay(struct obs_data *data, struct obs_source *obsSource);
   ~AirPlay();
   auto getWidth() const -> int;
@@ -16,8 +43,12 @@ public:
   auto name() const -> const char *;
   auto update(struct obs_data *data) -> void;
   auto apply_settings() -> void;
+  auto tick() -> void;
 
 private:
+  // drives the server callbacks in the standalone tools under tools/
+  friend struct AirPlayHarness;
+
   auto render(const audio_decode_struct *data) -> void;
   auto render(const h264_decode_struct *data) -> void;
   auto start_raop_server(std::vector<char> hw_addr,
@@ -27,6 +58,27 @@ private:
                          bool debug_log) -> int;
   auto stop_raop_server() -> int;
   auto restart_server_with_settings(const std::string& name, bool use_random_mac) -> void;
+  auto network_ports(unsigned short tcp[3], unsigned short udp[3]) -> void;
+  auto tune_udp_sockets() -> void;
+  auto report_udp_stats() -> void;
+  auto udp_ports() -> std::array<unsigned short, 3>;
+  auto apply_log_levels(struct obs_data *data) -> void;
+  auto publish_now_playing() -> void;
+  auto write_cover_art(const uint8_t *data, int len, const char *extension) -> std::string;
+  auto set_low_latency(bool) -> void;
+  auto set_thread_policy(struct obs_data *data) -> void;
+  auto update_max_output_size() -> void;
+  auto update_frame_interval() -> void;
+  auto set_frame_export(struct obs_data *data) -> void;
+  auto default_frame_export_name() const -> std::string;
+  auto on_output_cadence(uint64_t pts) -> bool;
+  auto output_video(const VFrame *vFrame, uint64_t pts) -> void;
+  auto export_picture(uint64_t pts) -> void;
+  auto output_pending() -> void;
+  auto schedule_refresh(int64_t arrival) -> void;
+  auto refresh_loop() -> void;
+  auto log_resource_usage(const char *when) const -> void;
+  auto apply_thread_policy(const char *name) -> void;
 
   // Server callbacks
   static auto audio_flush(void *cls) -> void;
@@ -38,11 +90,14 @@ private:
                                uint64_t *audioFormat) -> void;
   static auto audio_process(void *cls, struct raop_ntp_s *ntp, audio_decode_struct *data) -> void;
   static auto audio_set_metadata(void *cls, const void *buffer, int buflen) -> void;
+  static auto audio_set_coverart(void *cls, const void *buffer, int buflen) -> void;
   static auto audio_set_volume(void *cls, float volume) -> void;
   static auto conn_destroy(void *cls) -> void;
   static auto conn_init(void *cls) -> void;
   static auto conn_reset(void *cls, int timeouts, bool reset_video) -> void;
   static auto conn_teardown(void *cls, bool *teardown_96, bool *teardown_110) -> void;
+  static auto get_now_playing(void *data, struct calldata *cd) -> void;
+  static auto get_stats(void *data, struct calldata *cd) -> void;
   static auto log_callback(void *cls, int level, const char *msg) -> void;
   static auto video_flush(void *cls) -> void;
   static auto video_process(void *cls, struct raop_ntp_s *ntp, h264_decode_struct *data) -> void;
@@ -55,17 +110,88 @@ private:
   struct obs_data *obsData;
   struct obs_source *obsSource;
   std::unique_ptr<struct obs_source_frame> obsVFrame;
-  H264Decoder vDecoder;
+  VideoDecoder vDecoder;
+  std::mutex vDecoderMutex;
   std::unique_ptr<struct obs_source_audio> obsAFrame;
   AudioDecoder aDecoder;
-  bool connections_stopped = false;
+  PcmProcessor pcm;
+  // consecutive buffers of digital silence, past a short run they are not sent to OBS
+  int silentBuffers = 0;
+  Session session;
   unsigned int counter = 0;
   unsigned char compression_type = 0;
   struct raop_s *raop = NULL;
   struct dnssd_s *dnssd = NULL;
-  int open_connections = 0;
-  int width = 100;
-  int height = 100;
+  std::atomic<int> width = 100;
+  std::atomic<int> height = 100;
+  // steady clock time in ns when the last connection went away, 0 while a device is connected or
+  // after the decoder memory has been released
+  std::atomic<int64_t> idleSince = 0;
+  // steady clock time in ns of the first connection of a session until its first frame is out
+  std::atomic<int64_t> connectTime = 0;
+  // steady clock time in ns the first video packet of the session arrived at, 0 before that
+  std::atomic<int64_t> firstPacketTime = 0;
+  // guarded by vDecoderMutex
+  StreamStats streamStats;
+  // decoded pictures published to other processes, guarded by vDecoderMutex
+  std::unique_ptr<ShmFrameWriter> frameExport;
+  // steady clock time in ns of the last frame handed to OBS, guarded by vDecoderMutex
+  int64_t lastOutputTime = 0;
+  // sender pts in us of the last decoded packet, output with the decoder's pending picture,
+  // guarded by vDecoderMutex
+  uint64_t pendingPts = 0;
+  // the pending picture was skipped by on_output_cadence(), guarded by vDecoderMutex
+  bool pendingDecimated = false;
+  // steady clock time in ns the last video packet arrived at, guarded by vDecoderMutex
+  int64_t lastPacketTime = 0;
+  // refresh_loop() outputs the pending picture at refreshDeadline, steady clock ns, 0 for none.
+  // refreshDeadline and refreshStop are guarded by vDecoderMutex.
+  std::condition_variable refreshCv;
+  int64_t refreshDeadline = 0;
+  bool refreshStop = false;
+  std::thread refreshThread;
+  // sessions since the server was started, numbered in the first-frame log
+  std::atomic<int> sessions = 0;
+  // set by conn_destroy, tick() logs the session summary off the raop threads
+  std::atomic<bool> sessionEnded = false;
+  std::atomic<LogLevel> raopLogLevel = LogLevel::info;
+  // frames are stamped on arrival and shown by OBS without async buffering
+  std::atomic<bool> lowLatency = false;
+  // arrival time minus sender pts of the latest video frame in low latency mode, in ns, audio is
+  // moved by the same amount to stay aligned with the video
+  std::atomic<int64_t> clockOffset = 0;
+  std::atomic<int> maxOutputSize = 0;
+  // OBS frame interval in ns, packets arriving faster are decoded but not converted or output
+  std::atomic<int64_t> frameInterval = 0;
+  // sender pts in ns the next frame is due at, only used on the video thread
+  int64_t nextFramePts = 0;
+  std::atomic<uint64_t> decimatedFrames = 0;
+  // taken once the server first runs, later snapshots are logged relative to it to spot leaks
+  ResourceUsage baselineUsage;
+  std::mutex threadPolicyMutex;
+  ThreadPolicy threadPolicy;
+  // bumped on every settings change, each receive thread reapplies the policy when it sees a new
+  // generation
+  std::atomic<int> threadPolicyGeneration = 1;
+  std::mutex nowPlayingMutex;
+  NowPlaying nowPlaying;
+  uint64_t coverArtHash = 0;
+  // audio callback thread only, created with the first artwork
+  std::string coverArtDir;
+  int coverArtFiles = 0;
+  std::atomic<int> idleReleaseDelay = 0;
+  // 0 lets the raop library pick the ports dynamically
+  int networkPort = 0;
+  std::mutex udpMutex;
+  std::array<unsigned short, 3> udpPorts = {};
+  std::atomic<int> udpReceiveBuffer = 0;
+  std::atomic<bool> udpSocketsTuned = false;
+  // tick() only
+  int64_t lastUdpStats = 0;
+  std::array<long, 3> udpPortDrops = {};
+  // totals of the last report, read by get_stats
+  std::atomic<long> udpDrops = 0;
+  std::atomic<long> udpRxQueue = 0;
   
   // Settings for dynamic AirPlay Server name
   std::string current_server_name;
@@ -0,0 +1,100 @@
+#pragma once
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <span>
+#include <vector>
+
+enum class VideoCodec { h264, hevc };
+
+// Calls f(nal) for every NAL unit of an Annex B byte stream, nal excludes the start code and
+// points into data
+template <typename F>
+auto forEachNal(std::span<const uint8_t> data, F f) -> void
+{
+  auto startCode = [&](size_t i) {
+    return i + 3 <= data.size() && data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1;
+  };
+  auto i = size_t{0};
+  while (i < data.size() && !startCode(i))
+    ++i;
+  while (i < data.size())
+  {
+    const auto begin = i + 3;
+    auto end = begin;
+    while (end < data.size() && !startCode(end))
+      ++end;
+    i = end;
+    // trailing zero belongs to the next 4-byte start code
+    while (end > begin && data[end - 1] == 0)
+      --end;
+    if (end > begin)
+      f(data.subspan(begin, end - begin));
+  }
+}
+
+enum class Nal { other, vps, sps, pps, idr, slice };
+
+inline auto classify(VideoCodec codec, uint8_t header) -> Nal
+{
+  if (codec == VideoCodec::h264)
+    switch (header & 0x1f)
+    {
+    case 1: return Nal::slice;
+    case 5: return Nal::idr;
+    case 7: return Nal::sps;
+    case 8: return Nal::pps;
+    default: return Nal::other;
+    }
+  const auto type = (header >> 1) & 0x3f;
+  switch (type)
+  {
+  case 19: // IDR_W_RADL
+  case 20: // IDR_N_LP
+  case 21: // CRA
+    return Nal::idr;
+  case 32: return Nal::vps;
+  case 33: return Nal::sps;
+  case 34: return Nal::pps;
+  default: return type < 32 ? Nal::slice : Nal::other;
+  }
+}
+
+// Parameter sets open every stream. 0x40 0x01 is an HEVC VPS header, a header byte of 0x40 is
+// never used by H.264 (type 0).
+inline auto detectCodec(uint8_t header, uint8_t next) -> std::optional<VideoCodec>
+{
+  if (header == 0x40 && next == 0x01)
+    return VideoCodec::hevc;
+  if ((header & 0x9f) == 0x07 && (header & 0x60))
+    return VideoCodec::h264;
+  return std::nullopt;
+}
+
+// Splits a recorded stream into the packets the raop server hands to the decoder: a picture starts
+// with a parameter set or with the first slice of a picture. Each packet keeps 4-byte start codes.
+inline auto accessUnits(std::span<const uint8_t> stream) -> std::vector<std::vector<uint8_t>>
+{
+  std::vector<std::vector<uint8_t>> ret;
+  auto codec = std::optional<VideoCodec>{};
+  auto hasSlice = false;
+  forEachNal(stream, [&](std::span<const uint8_t> nal) {
+    if (!codec && nal.size() > 1)
+      codec = detectCodec(nal[0], nal[1]);
+    const auto type = classify(codec.value_or(VideoCodec::h264), nal[0]);
+    const auto slice = type == Nal::idr || type == Nal::slice;
+    // first_mb_in_slice == 0 and first_slice_segment_in_pic_flag are both a leading 1 bit
+    const auto firstSlice = codec == VideoCodec::hevc ? nal.size() > 2 && nal[2] & 0x80
+                                                      : nal.size() > 1 && nal[1] & 0x80;
+    if (ret.empty() || (hasSlice && (!slice || firstSlice)))
+    {
+      ret.emplace_back();
+      hasSlice = false;
+    }
+    hasSlice = hasSlice || slice;
+    const uint8_t startCode[] = {0, 0, 0, 1};
+    ret.back().insert(ret.back().end(), std::begin(startCode), std::end(startCode));
+    ret.back().insert(ret.back().end(), nal.begin(), nal.end());
+  });
+  return ret;
+}
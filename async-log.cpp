@@ -0,0 +1,96 @@
+#include "async-log.hpp"
+#include <algorithm>
+#include <chrono>
+#include <obs/obs.h>
+
+auto AsyncLog::Msg::append(std::string_view v) -> void
+{
+  const auto n = std::min(v.size(), text.size() - 1 - len);
+  memcpy(text.data() + len, v.data(), n);
+  len += n;
+  text[len] = '\0';
+}
+
+auto AsyncLog::instance() -> AsyncLog &
+{
+  static AsyncLog log;
+  return log;
+}
+
+AsyncLog::AsyncLog()
+{
+  for (auto &l : levels)
+    l = LogLevel::info;
+  for (auto i = 0U; i < ring.size(); ++i)
+    ring[i].seq = i;
+  thread = std::thread([this]() {
+    while (running)
+    {
+      drain();
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    drain();
+  });
+}
+
+AsyncLog::~AsyncLog()
+{
+  stop();
+}
+
+auto AsyncLog::stop() -> void
+{
+  running = false;
+  if (thread.joinable())
+    thread.join();
+}
+
+auto AsyncLog::setLevel(LogSubsystem subsystem, LogLevel level) -> void
+{
+  levels[static_cast<int>(subsystem)] = level;
+}
+
+auto AsyncLog::push(LogLevel level, const Msg &msg) -> void
+{
+  // bounded multi-producer queue: a producer claims a slot by advancing head, the slot sequence
+  // tells whether the consumer has released it yet
+  auto pos = head.load(std::memory_order_relaxed);
+  Slot *slot;
+  for (;;)
+  {
+    slot = &ring[pos % RingSize];
+    const auto seq = slot->seq.load(std::memory_order_acquire);
+    const auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+    if (diff == 0)
+    {
+      if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        break;
+    }
+    else if (diff < 0)
+    {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    else
+      pos = head.load(std::memory_order_relaxed);
+  }
+  slot->level = level;
+  slot->msg = msg;
+  slot->seq.store(pos + 1, std::memory_order_release);
+}
+
+auto AsyncLog::drain() -> void
+{
+  static const int blogLevels[] = {LOG_ERROR, LOG_WARNING, LOG_INFO, LOG_DEBUG};
+  for (;;)
+  {
+    auto &slot = ring[tail % RingSize];
+    if (slot.seq.load(std::memory_order_acquire) != tail + 1)
+      break;
+    blog(blogLevels[static_cast<int>(slot.level)], "[obs-airplay] %s", slot.msg.text.data());
+    slot.seq.store(tail + RingSize, std::memory_order_release);
+    ++tail;
+  }
+  if (const auto n = dropped.exchange(0, std::memory_order_relaxed))
+    blog(LOG_WARNING, "[obs-airplay] log ring full, %zu messages dropped", n);
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+enum class LogSubsystem { raop, session, video, audio, count };
+// same order as the OBS blog levels
+enum class LogLevel { error, warning, info, debug };
+
+// Logger for the UxPlay callback threads. Messages are formatted into a fixed-size slot of a
+// lock-free ring buffer and handed to blog() by a background thread, so the receive threads never
+// block on the OBS log. When the ring is full new messages are dropped and counted.
+class AsyncLog
+{
+public:
+  static constexpr auto MsgSize = 256;
+
+  struct Msg
+  {
+    std::array<char, MsgSize> text = {};
+    int len = 0;
+    auto append(std::string_view) -> void;
+  };
+
+  static auto instance() -> AsyncLog &;
+  ~AsyncLog();
+  auto enabled(LogSubsystem subsystem, LogLevel level) const -> bool
+  {
+    return level <= levels[static_cast<int>(subsystem)].load(std::memory_order_relaxed);
+  }
+  auto setLevel(LogSubsystem, LogLevel) -> void;
+  auto push(LogLevel, const Msg &) -> void;
+  auto stop() -> void;
+
+private:
+  AsyncLog();
+  auto drain() -> void;
+
+  static constexpr auto RingSize = 1024;
+  struct Slot
+  {
+    std::atomic<size_t> seq;
+    LogLevel level;
+    Msg msg;
+  };
+  std::array<std::atomic<LogLevel>, static_cast<int>(LogSubsystem::count)> levels;
+  std::array<Slot, RingSize> ring;
+  std::atomic<size_t> head = 0;
+  size_t tail = 0;
+  std::atomic<size_t> dropped = 0;
+  std::atomic<bool> running = true;
+  std::thread thread;
+};
+
+namespace internal
+{
+  inline auto logAppend(AsyncLog::Msg &m, std::string_view v) -> void
+  {
+    m.append(v);
+  }
+  inline auto logAppend(AsyncLog::Msg &m, const char *v) -> void
+  {
+    m.append(v ? v : "(null)");
+  }
+  inline auto logAppend(AsyncLog::Msg &m, bool v) -> void
+  {
+    m.append(v ? "true" : "false");
+  }
+  template <typename T>
+  auto logAppend(AsyncLog::Msg &m, T v) -> std::enable_if_t<std::is_arithmetic_v<T>>
+  {
+    char buf[32];
+    int len;
+    if constexpr (std::is_floating_point_v<T>)
+      len = snprintf(buf, sizeof(buf), "%g", static_cast<double>(v));
+    else
+      len = std::to_chars(buf, buf + sizeof(buf), v).ptr - buf;
+    m.append({buf, static_cast<size_t>(len)});
+  }
+} // namespace internal
+
+template <typename... Args>
+auto asyncLog(LogSubsystem subsystem, LogLevel level, Args &&...args) -> void
+{
+  auto &log = AsyncLog::instance();
+  if (!log.enabled(subsystem, level))
+    return;
+  AsyncLog::Msg msg;
+  auto first = true;
+  (
+    [&](auto &&arg) {
+      if (!first)
+        msg.append(" ");
+      first = false;
+      internal::logAppend(msg, arg);
+    }(args),
+    ...);
+  log.push(level, msg);
+}
+
+// The level check happens before any argument is evaluated or formatted
+#define ALOG(subsystem, level, ...)                                                  \
+  do                                                                                 \
+  {                                                                                  \
+    if (AsyncLog::instance().enabled(LogSubsystem::subsystem, LogLevel::level))      \
+      asyncLog(LogSubsystem::subsystem, LogLevel::level, __VA_ARGS__);               \
+  } while (false)
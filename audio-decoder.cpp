@@ -1,55 +1,131 @@
 #include "audio-decoder.hpp"
+#include "async-log.hpp"
 #include <fdk-aac/aacdecoder_lib.h>
-#include <log/log.hpp>
 
-auto AudioDecoder::decode(std::span<const uint8_t> data) -> const AFrame *
+static auto samplingFrequencyIndex(int sampleRate) -> int
 {
-  auto c = [=]() {
-    switch (data[0])
+  static const int rates[] = {
+    96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350};
+  for (auto i = 0U; i < sizeof(rates) / sizeof(rates[0]); ++i)
+    if (rates[i] == sampleRate)
+      return i;
+  return -1;
+}
+
+// AudioSpecificConfig for AAC-ELD with 480 samples per frame, no SBR and no extensions
+static auto eldConfig(int freqIdx, int channels) -> std::array<UCHAR, 4>
+{
+  uint32_t bits = 0;
+  bits |= 31u << 27; // audioObjectType escape
+  bits |= (39u - 32u) << 21; // audioObjectTypeExt: ER AAC ELD
+  bits |= static_cast<uint32_t>(freqIdx) << 17;
+  bits |= static_cast<uint32_t>(channels) << 13;
+  bits |= 1u << 12; // frameLengthFlag: 480
+  return {static_cast<UCHAR>(bits >> 24),
+          static_cast<UCHAR>(bits >> 16),
+          static_cast<UCHAR>(bits >> 8),
+          static_cast<UCHAR>(bits)};
+}
+
+auto AudioDecoder::open(AudioFormat format) -> AAC_DECODER_INSTANCE *
+{
+  switch (format.codec)
+  {
+  case AudioCodec::aacLc: {
+    // AAC-LC arrives as ADTS, the decoder picks the configuration up from the headers
+    auto d = aacDecoder_Open(TT_MP4_ADTS, 1);
+    if (!d)
+      ALOG(audio, error, "aacDecoder_Open failed");
+    return d;
+  }
+  case AudioCodec::aacEld: {
+    const auto freqIdx = samplingFrequencyIndex(format.sampleRate);
+    if (freqIdx < 0)
+    {
+      ALOG(audio, error, "Unsupported AAC-ELD sample rate:", format.sampleRate);
+      return nullptr;
+    }
+    auto d = aacDecoder_Open(TT_MP4_RAW, 1);
+    if (!d)
+    {
+      ALOG(audio, error, "aacDecoder_Open failed");
+      return nullptr;
+    }
+    auto conf = eldConfig(freqIdx, format.channels);
+    UCHAR *conf_array[1] = {conf.data()};
+    UINT length = conf.size();
+    auto err = aacDecoder_ConfigRaw(d, conf_array, &length);
+    if (err != AAC_DEC_OK)
+    {
+      ALOG(audio, error, "aacDecoder_ConfigRaw failed:", err);
+      aacDecoder_Close(d);
+      return nullptr;
+    }
+    return d;
+  }
+  case AudioCodec::alac:
+  case AudioCodec::unsupported: break;
+  }
+  ALOG(audio, warning, "audio-format is not supported");
+  return nullptr;
+}
+
+auto AudioDecoder::setFormat(AudioFormat format) -> bool
+{
+  for (const auto &[f, d] : decoders)
+    if (f == format)
     {
-    case 0x8c:
-    case 0x8d:
-    case 0x8e:
-    case 0x80:
-    case 0x81:
-    case 0x82: return AudioCodec::aacEld;
-    case 0xff: return AudioCodec::aacLc;
-    case 0x20: return AudioCodec::alac;
+      decoder = d;
+      return d != nullptr;
     }
-    LOG("Unknown audio codec:", data[0]);
-    return AudioCodec::unsupported;
-  }();
+  auto d = open(format);
+  // unsupported formats are cached as well, so they are not retried on every session
+  decoders.emplace_back(format, d);
+  decoder = d;
+  return d != nullptr;
+}
 
-  if (c == AudioCodec::alac || c == AudioCodec::unsupported)
-  {
-    LOG("audio-format is not supported");
+auto AudioDecoder::flush() -> void
+{
+  flushRequested = true;
+}
+
+auto AudioDecoder::decode(std::span<const uint8_t> data) -> AFrame *
+{
+  auto dec = decoder.load();
+  if (!dec)
     return nullptr;
+  if (flushRequested.exchange(false))
+  {
+    auto err = aacDecoder_SetParam(dec, AAC_TPDEC_CLEAR_BUFFER, 1);
+    if (err != AAC_DEC_OK)
+      ALOG(audio, warning, "aacDecoder_SetParam(AAC_TPDEC_CLEAR_BUFFER) failed:", err);
   }
 
   UINT bytesValid = data.size();
   {
     uint8_t *d[2] = {const_cast<uint8_t *>(data.data()), nullptr};
     UINT size[2] = {static_cast<UINT>(data.size()), 0};
-    auto err = aacDecoder_Fill(decoder, d, size, &bytesValid);
+    auto err = aacDecoder_Fill(dec, d, size, &bytesValid);
     if (err != AAC_DEC_OK)
     {
-      LOG("aacDecoder_Fill failed:", err);
+      ALOG(audio, warning, "aacDecoder_Fill failed:", err);
       return nullptr;
     }
   }
   {
-    auto err = aacDecoder_DecodeFrame(decoder, frame.data(), frame.size(), 0);
+    auto err = aacDecoder_DecodeFrame(dec, frame.data(), frame.size(), 0);
     if (err != AAC_DEC_OK)
     {
-      LOG("aacDecoder_DecodeFrame failed:", err);
+      ALOG(audio, warning, "aacDecoder_DecodeFrame failed:", err);
       return nullptr;
     }
   }
   {
-    auto info = aacDecoder_GetStreamInfo(decoder);
+    auto info = aacDecoder_GetStreamInfo(dec);
     if (info == nullptr)
     {
-      LOG("aacDecoder_GetStreamInfo failed");
+      ALOG(audio, warning, "aacDecoder_GetStreamInfo failed");
       return nullptr;
     }
     obsFrame.sampleRate = info->sampleRate;
@@ -61,7 +137,7 @@ auto AudioDecoder::decode(std::span<const uint8_t> data) -> const AFrame *
     case 2: // stereo
       obsFrame.speakers = SPEAKERS_STEREO;
       break;
-    default: LOG("Unknown channel config:", info->channelConfig); return nullptr;
+    default: ALOG(audio, warning, "Unknown channel config:", info->channelConfig); return nullptr;
     }
     const auto samples = info->numChannels * info->frameSize;
     obsFrame.data.clear();
@@ -70,23 +146,15 @@ auto AudioDecoder::decode(std::span<const uint8_t> data) -> const AFrame *
   return &obsFrame;
 }
 
-AudioDecoder::AudioDecoder() : decoder(aacDecoder_Open(TT_MP4_RAW, 1))
+AudioDecoder::AudioDecoder()
 {
-  {
-    // AAC-ELD 44100 STEREO
-    UCHAR conf[] = {0xF8, 0xE8, 0x50, 0x00};
-    UCHAR *conf_array[1] = {conf};
-    UINT length = 4;
-    auto err = aacDecoder_ConfigRaw(decoder, conf_array, &length);
-    if (err != AAC_DEC_OK)
-    {
-      LOG("aacDecoder_ConfigRaw failed:", err);
-      return;
-    }
-  }
+  // AAC-ELD 44100 STEREO until the session negotiates something else
+  setFormat(AudioFormat{});
 }
 
 AudioDecoder::~AudioDecoder()
 {
-  aacDecoder_Close(decoder);
+  for (const auto &[f, d] : decoders)
+    if (d)
+      aacDecoder_Close(d);
 }
@@ -1,8 +1,10 @@
 #pragma once
 #include <array>
+#include <atomic>
 #include <cstdint>
 #include <obs/obs.h>
 #include <span>
+#include <utility>
 #include <vector>
 
 struct AFrame
@@ -14,15 +16,33 @@ struct AFrame
 
 enum class AudioCodec { aacEld, aacLc, alac, unsupported };
 
+struct AudioFormat
+{
+  AudioCodec codec = AudioCodec::aacEld;
+  int sampleRate = 44100;
+  int channels = 2;
+  auto operator==(const AudioFormat &) const -> bool = default;
+};
+
 class AudioDecoder
 {
 public:
   AudioDecoder();
   ~AudioDecoder();
-  auto decode(std::span<const uint8_t> data) -> const AFrame *;
+  // Selects the decoder for the format negotiated at session setup. Decoders are opened once per
+  // format and reused, so switching back and forth between mirroring and media audio does not
+  // reopen fdk-aac.
+  auto setFormat(AudioFormat) -> bool;
+  auto decode(std::span<const uint8_t> data) -> AFrame *;
+  // Can be called from any thread, the decoder buffers are cleared by the next decode() call.
+  auto flush() -> void;
 
 private:
-  struct AAC_DECODER_INSTANCE *decoder = nullptr;
+  auto open(AudioFormat) -> struct AAC_DECODER_INSTANCE *;
+
+  std::vector<std::pair<AudioFormat, struct AAC_DECODER_INSTANCE *>> decoders;
+  std::atomic<struct AAC_DECODER_INSTANCE *> decoder = nullptr;
+  std::atomic<bool> flushRequested = false;
   AFrame obsFrame;
   std::array<int16_t, 8192> frame;
 };
@@ -0,0 +1,43 @@
+#include "daap.hpp"
+
+static constexpr auto fourcc(const char (&tag)[5]) -> uint32_t
+{
+  return (static_cast<uint32_t>(static_cast<uint8_t>(tag[0])) << 24) |
+         (static_cast<uint32_t>(static_cast<uint8_t>(tag[1])) << 16) |
+         (static_cast<uint32_t>(static_cast<uint8_t>(tag[2])) << 8) |
+         static_cast<uint32_t>(static_cast<uint8_t>(tag[3]));
+}
+
+static auto be32(const uint8_t *p) -> uint32_t
+{
+  return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+         (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+auto parseDaap(std::span<const uint8_t> data) -> DaapMetadata
+{
+  DaapMetadata ret;
+  auto pos = size_t{0};
+  while (pos + 8 <= data.size())
+  {
+    const auto tag = be32(data.data() + pos);
+    const auto len = be32(data.data() + pos + 4);
+    pos += 8;
+    // the listing item is a container, its children follow its header
+    if (tag == fourcc("mlit"))
+      continue;
+    if (len > data.size() - pos)
+      break;
+    const auto value = std::string_view(reinterpret_cast<const char *>(data.data() + pos), len);
+    switch (tag)
+    {
+    case fourcc("minm"): ret.title = value; break;
+    case fourcc("asar"): ret.artist = value; break;
+    case fourcc("asal"): ret.album = value; break;
+    case fourcc("ascp"): ret.composer = value; break;
+    case fourcc("asgn"): ret.genre = value; break;
+    }
+    pos += len;
+  }
+  return ret;
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+// Now-playing fields of a DAAP listing item, the views point into the parsed buffer
+struct DaapMetadata
+{
+  std::string_view title;
+  std::string_view artist;
+  std::string_view album;
+  std::string_view composer;
+  std::string_view genre;
+};
+
+// Single pass over the tag/length/value items of a DAAP buffer, does not allocate
+auto parseDaap(std::span<const uint8_t> data) -> DaapMetadata;
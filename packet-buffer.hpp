@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+
+// Copy of a packet followed by zeroed padding. FFmpeg's bitstream readers may read up to
+// AV_INPUT_BUFFER_PADDING_SIZE bytes past the end of the data they are given, the buffers the raop
+// library decrypts into carry none. The storage is kept across packets, it grows to the largest
+// packet once and the copy is all that is left per packet.
+class PacketBuffer
+{
+public:
+  explicit PacketBuffer(size_t padding) : padding(padding) {}
+
+  // Returns the copy, without the padding. Valid until the next assign() or clear().
+  auto assign(std::span<const uint8_t> data) -> std::span<const uint8_t>
+  {
+    const auto size = data.size();
+    if (buffer.size() < size + padding)
+      buffer.resize(size + padding);
+    if (size)
+      memcpy(buffer.data(), data.data(), size);
+    memset(buffer.data() + size, 0, padding);
+    return {buffer.data(), size};
+  }
+
+  // Frees the storage
+  auto clear() -> void { std::vector<uint8_t>().swap(buffer); }
+
+  auto capacity() const -> size_t { return buffer.size(); }
+
+private:
+  size_t padding;
+  std::vector<uint8_t> buffer;
+};
@@ -0,0 +1,66 @@
+#include "pcm-processor.hpp"
+#include <algorithm>
+#include <cmath>
+
+static auto saturate(int32_t v) -> int16_t
+{
+  return static_cast<int16_t>(std::clamp(v, int32_t{-32768}, int32_t{32767}));
+}
+
+static auto applyGain(int16_t *__restrict s, size_t n, int32_t gain) -> void
+{
+  for (auto i = size_t{0}; i < n; ++i)
+    s[i] = saturate((s[i] * gain) >> 15);
+}
+
+static auto applyRamp(int16_t *__restrict s, size_t frames, int channels, int32_t from, int32_t to)
+  -> void
+{
+  // interpolated per frame, the last frame gets exactly the target gain
+  const auto delta = static_cast<int64_t>(to - from);
+  for (auto f = size_t{0}; f < frames; ++f)
+  {
+    const auto g =
+      from + static_cast<int32_t>(delta * static_cast<int64_t>(f + 1) / static_cast<int64_t>(frames));
+    for (auto c = 0; c < channels; ++c)
+      s[f * channels + c] = saturate((s[f * channels + c] * g) >> 15);
+  }
+}
+
+static auto isSilent(const int16_t *__restrict s, size_t n) -> bool
+{
+  auto acc = 0;
+  for (auto i = size_t{0}; i < n; ++i)
+    acc |= s[i];
+  return acc == 0;
+}
+
+auto PcmProcessor::setVolume(float db) -> void
+{
+  if (db <= -144.0f)
+  {
+    targetGain = 0;
+    return;
+  }
+  targetGain = static_cast<int32_t>(std::lround(std::pow(10.0f, std::min(db, 0.0f) / 20.0f) * Unity));
+}
+
+auto PcmProcessor::process(std::span<int16_t> samples, int channels) -> bool
+{
+  if (samples.empty() || channels <= 0)
+    return true;
+  const auto target = targetGain.load(std::memory_order_relaxed);
+  if (target != gain)
+  {
+    applyRamp(samples.data(), samples.size() / channels, channels, gain, target);
+    gain = target;
+  }
+  else if (gain == 0)
+  {
+    std::fill(samples.begin(), samples.end(), 0);
+    return true;
+  }
+  else if (gain != Unity)
+    applyGain(samples.data(), samples.size(), gain);
+  return isSilent(samples.data(), samples.size());
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <span>
+
+// Post-decode stage on interleaved 16-bit PCM: applies the sender's volume and detects digital
+// silence. The kernels are plain loops over fixed-point samples the compiler vectorizes.
+class PcmProcessor
+{
+public:
+  static constexpr int32_t Unity = 1 << 15;
+
+  // AirPlay volume in dB: -144 is mute, otherwise -30..0. Can be called from any thread.
+  auto setVolume(float db) -> void;
+  // Scales the samples in place, ramping from the previous gain to the new one across the buffer
+  // to avoid zipper noise. Returns true if the result is digital silence.
+  auto process(std::span<int16_t> samples, int channels) -> bool;
+
+private:
+  std::atomic<int32_t> targetGain = Unity;
+  int32_t gain = Unity;
+};
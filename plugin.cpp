@@ -1,4 +1,5 @@
 #include "airplay.hpp"
+#include "async-log.hpp"
 #include <log/log.hpp>
 #include <map>
 #include <string>
@@ -19,7 +20,31 @@ static std::map<std::string, std::map<std::string, std::string>> locale_strings
     {"MacAddressLabel", "MAC Address Settings"},
     {"MacAddressLabelDescription", "Configure which MAC Address is being used."},
     {"UseRandomMac", "Use Random MAC Address"},
-    {"RandomMacInfo", "When unchecked, uses the system's MAC address. Random MAC is recommended to prevent iOS connection issues caused by device caching."}
+    {"RandomMacInfo", "When unchecked, uses the system's MAC address. Random MAC is recommended to prevent iOS connection issues caused by device caching."},
+    {"IdleReleaseDelay", "Release decoder memory when idle after (s, 0 = never)"},
+    {"NetworkPort", "Network ports n, n+1, n+2 (0 = dynamic)"},
+    {"UdpReceiveBuffer", "UDP receive buffer (KiB, 0 = system default, needs fixed ports)"},
+    {"LowLatency", "Lowest Latency (show frames on arrival, no buffering)"},
+    {"MaxOutputSize", "Max output resolution (scaled while converting)"},
+    {"MaxOutputOriginal", "Sender resolution"},
+    {"MaxOutputCanvas", "Canvas size"},
+    {"FrameExport", "Export decoded frames to shared memory"},
+    {"FrameExportName", "Shared memory name"},
+    {"FrameExportNameDefault", "Empty: /obs-airplay-<source name>. Each source needs its own name."},
+    {"ThreadCpus", "Pin receive/decode threads to CPUs (e.g. 2,3 or 4-7)"},
+    {"ThreadPriority", "Receive/decode thread priority"},
+    {"PriorityNormal", "Normal"},
+    {"PriorityHigh", "High"},
+    {"PriorityRealtime", "Realtime (SCHED_FIFO)"},
+    {"LogLevelSession", "Session Log Level"},
+    {"LogLevelVideo", "Video Log Level"},
+    {"LogLevelAudio", "Audio Log Level"},
+    {"RaopLogLevel", "AirPlay Protocol Log Level"},
+    {"LogLevelShared", "Plugin messages are logged at the most verbose level set on any AirPlay source."},
+    {"LogError", "Error"},
+    {"LogWarning", "Warning"},
+    {"LogInfo", "Info"},
+    {"LogDebug", "Debug"}
   }},
   {"de-DE", {
     {"ServerName", "Server Name"},
@@ -28,7 +53,31 @@ static std::map<std::string, std::map<std::string, std::string>> locale_strings
     {"MacAddressLabel", "MAC-Adresse Einstellungen"},
     {"MacAddressLabelDescription", "Konfigurieren Sie, welche MAC -Adresse verwendet wird."},
     {"UseRandomMac", "Zufällige MAC-Adresse verwenden"},
-    {"RandomMacInfo", "Wenn deaktiviert, wird die System-MAC-Adresse verwendet. Zufällige MAC wird empfohlen, um iOS-Verbindungsprobleme durch Gerätecaching zu vermeiden."}
+    {"RandomMacInfo", "Wenn deaktiviert, wird die System-MAC-Adresse verwendet. Zufällige MAC wird empfohlen, um iOS-Verbindungsprobleme durch Gerätecaching zu vermeiden."},
+    {"IdleReleaseDelay", "Decoder-Speicher freigeben nach Leerlauf von (s, 0 = nie)"},
+    {"NetworkPort", "Netzwerk-Ports n, n+1, n+2 (0 = dynamisch)"},
+    {"UdpReceiveBuffer", "UDP-Empfangspuffer (KiB, 0 = Systemstandard, benötigt feste Ports)"},
+    {"LowLatency", "Geringste Latenz (Bilder sofort anzeigen, keine Pufferung)"},
+    {"MaxOutputSize", "Maximale Ausgabeauflösung (beim Konvertieren skaliert)"},
+    {"MaxOutputOriginal", "Auflösung des Senders"},
+    {"MaxOutputCanvas", "Leinwandgröße"},
+    {"FrameExport", "Dekodierte Bilder in Shared Memory exportieren"},
+    {"FrameExportName", "Name des Shared Memory"},
+    {"FrameExportNameDefault", "Leer: /obs-airplay-<Name der Quelle>. Jede Quelle braucht einen eigenen Namen."},
+    {"ThreadCpus", "Empfangs-/Decoder-Threads an CPUs binden (z. B. 2,3 oder 4-7)"},
+    {"ThreadPriority", "Priorität der Empfangs-/Decoder-Threads"},
+    {"PriorityNormal", "Normal"},
+    {"PriorityHigh", "Hoch"},
+    {"PriorityRealtime", "Echtzeit (SCHED_FIFO)"},
+    {"LogLevelSession", "Protokollstufe Sitzung"},
+    {"LogLevelVideo", "Protokollstufe Video"},
+    {"LogLevelAudio", "Protokollstufe Audio"},
+    {"RaopLogLevel", "Protokollstufe AirPlay-Protokoll"},
+    {"LogLevelShared", "Plugin-Meldungen werden mit der ausführlichsten Stufe aller AirPlay-Quellen protokolliert."},
+    {"LogError", "Fehler"},
+    {"LogWarning", "Warnung"},
+    {"LogInfo", "Info"},
+    {"LogDebug", "Debug"}
   }}
 };
 
@@ -95,10 +144,28 @@ static auto sourceHeight(void *v) -> uint32_t
   return static_cast<AirPlay *>(v)->getHeight();
 }
 
+static auto sourceTick(void *v, float /*seconds*/) -> void
+{
+  static_cast<AirPlay *>(v)->tick();
+}
+
 static auto sourceGetDefaults(obs_data_t *data) -> void
 {
   obs_data_set_default_string(data, "server_name", "OBS");
   obs_data_set_default_bool(data, "use_random_mac", true);
+  obs_data_set_default_int(data, "idle_release_delay", 30);
+  obs_data_set_default_int(data, "network_port", 0);
+  obs_data_set_default_int(data, "udp_receive_buffer", 0);
+  obs_data_set_default_bool(data, "low_latency", false);
+  obs_data_set_default_int(data, "max_output_size", 0);
+  obs_data_set_default_bool(data, "frame_export", false);
+  obs_data_set_default_string(data, "frame_export_name", "");
+  obs_data_set_default_string(data, "thread_cpus", "");
+  obs_data_set_default_int(data, "thread_priority", static_cast<int>(ThreadPriority::normal));
+  obs_data_set_default_int(data, "log_level_session", static_cast<int>(LogLevel::info));
+  obs_data_set_default_int(data, "log_level_video", static_cast<int>(LogLevel::info));
+  obs_data_set_default_int(data, "log_level_audio", static_cast<int>(LogLevel::info));
+  obs_data_set_default_int(data, "raop_log_level", static_cast<int>(LogLevel::info));
   obs_data_set_default_string(data, "mac_address_label", get_text("MacAddressLabelDescription"));
   obs_data_set_default_string(data, "server_name_info", get_text("ServerNameInfo"));
   obs_data_set_default_string(data, "random_mac_info", get_text("RandomMacInfo"));
@@ -117,6 +184,16 @@ static bool apply_settings_clicked(obs_properties_t *props, obs_property_t *prop
   return false; // Don't refresh properties
 }
 
+static auto addLogLevelList(obs_properties_t *props, const char *name, const char *desc) -> void
+{
+  auto list = obs_properties_add_list(props, name, desc, OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+  obs_property_set_long_description(list, get_text("LogLevelShared"));
+  obs_property_list_add_int(list, get_text("LogError"), static_cast<int>(LogLevel::error));
+  obs_property_list_add_int(list, get_text("LogWarning"), static_cast<int>(LogLevel::warning));
+  obs_property_list_add_int(list, get_text("LogInfo"), static_cast<int>(LogLevel::info));
+  obs_property_list_add_int(list, get_text("LogDebug"), static_cast<int>(LogLevel::debug));
+}
+
 static auto sourceGetProperties(void *data) -> obs_properties_t *
 {
   obs_properties_t *props = obs_properties_create();
@@ -130,6 +207,40 @@ static auto sourceGetProperties(void *data) -> obs_properties_t *
   obs_properties_add_text(props, "mac_address_label", get_text("MacAddressLabel"), OBS_TEXT_INFO);
   obs_properties_add_bool(props, "use_random_mac", get_text("UseRandomMac"));
   obs_properties_add_text(props, "random_mac_info", "", OBS_TEXT_INFO);
+
+  obs_properties_add_int(props, "idle_release_delay", get_text("IdleReleaseDelay"), 0, 3600, 1);
+  obs_properties_add_int(props, "network_port", get_text("NetworkPort"), 0, 65533, 1);
+  obs_properties_add_int(props, "udp_receive_buffer", get_text("UdpReceiveBuffer"), 0, 65536, 64);
+
+  obs_properties_add_bool(props, "low_latency", get_text("LowLatency"));
+
+  auto maxOutput = obs_properties_add_list(
+    props, "max_output_size", get_text("MaxOutputSize"), OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+  obs_property_list_add_int(maxOutput, get_text("MaxOutputOriginal"), 0);
+  obs_property_list_add_int(maxOutput, get_text("MaxOutputCanvas"), AirPlay::MaxOutputCanvas);
+  obs_property_list_add_int(maxOutput, "2160p", 2160);
+  obs_property_list_add_int(maxOutput, "1440p", 1440);
+  obs_property_list_add_int(maxOutput, "1080p", 1080);
+  obs_property_list_add_int(maxOutput, "720p", 720);
+
+  obs_properties_add_bool(props, "frame_export", get_text("FrameExport"));
+  obs_properties_add_text(props, "frame_export_name", get_text("FrameExportName"), OBS_TEXT_DEFAULT);
+  obs_property_set_long_description(obs_properties_get(props, "frame_export_name"),
+                                    get_text("FrameExportNameDefault"));
+
+  obs_properties_add_text(props, "thread_cpus", get_text("ThreadCpus"), OBS_TEXT_DEFAULT);
+  auto priority = obs_properties_add_list(
+    props, "thread_priority", get_text("ThreadPriority"), OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+  obs_property_list_add_int(
+    priority, get_text("PriorityNormal"), static_cast<int>(ThreadPriority::normal));
+  obs_property_list_add_int(priority, get_text("PriorityHigh"), static_cast<int>(ThreadPriority::high));
+  obs_property_list_add_int(
+    priority, get_text("PriorityRealtime"), static_cast<int>(ThreadPriority::realtime));
+
+  addLogLevelList(props, "log_level_session", get_text("LogLevelSession"));
+  addLogLevelList(props, "log_level_video", get_text("LogLevelVideo"));
+  addLogLevelList(props, "log_level_audio", get_text("LogLevelAudio"));
+  addLogLevelList(props, "raop_log_level", get_text("RaopLogLevel"));
   
   return props;
 }
@@ -145,6 +256,7 @@ static struct obs_source_info source = {.id = "AirPlay",
                                         .update = sourceUpdate,
                                         .get_defaults = sourceGetDefaults,
                                         .get_properties = sourceGetProperties,
+                                        .video_tick = sourceTick,
                                         .icon_type = OBS_ICON_TYPE_DESKTOP_CAPTURE};
 
 bool obs_module_load(void)
@@ -152,4 +264,9 @@ bool obs_module_load(void)
   obs_register_source(&source);
   return true;
 }
+
+void obs_module_unload(void)
+{
+  AsyncLog::instance().stop();
+}
 }
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include "resource-usage.hpp"
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#ifndef __linux__
+#include <mach/mach.h>
+#endif
+
+static auto residentSetSize() -> long
+{
+#ifdef __linux__
+  std::ifstream statm("/proc/self/statm");
+  long size = 0, resident = 0;
+  if (!(statm >> size >> resident))
+    return -1;
+  return resident * sysconf(_SC_PAGESIZE);
+#else
+  mach_task_basic_info info;
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+    return -1;
+  return info.resident_size;
+#endif
+}
+
+auto openFileDescriptors() -> std::vector<int>
+{
+  std::vector<int> ret;
+#ifdef __linux__
+  auto dir = opendir("/proc/self/fd");
+#else
+  auto dir = opendir("/dev/fd");
+#endif
+  if (!dir)
+    return ret;
+  const auto self = dirfd(dir);
+  while (auto entry = readdir(dir))
+  {
+    if (entry->d_name[0] == '.')
+      continue;
+    const auto fd = atoi(entry->d_name);
+    if (fd != self)
+      ret.push_back(fd);
+  }
+  closedir(dir);
+  return ret;
+}
+
+static auto threadCount() -> int
+{
+#ifdef __linux__
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line))
+    if (line.rfind("Threads:", 0) == 0)
+      return std::stoi(line.substr(8));
+  return -1;
+#else
+  thread_act_array_t threads;
+  mach_msg_type_number_t count;
+  if (task_threads(mach_task_self(), &threads, &count) != KERN_SUCCESS)
+    return -1;
+  for (auto i = 0U; i < count; ++i)
+    mach_port_deallocate(mach_task_self(), threads[i]);
+  vm_deallocate(mach_task_self(), (vm_address_t)threads, count * sizeof(thread_act_t));
+  return count;
+#endif
+}
+
+auto resourceUsage() -> ResourceUsage
+{
+  const auto fds = openFileDescriptors();
+  return {residentSetSize(), fds.empty() ? -1 : static_cast<int>(fds.size()), threadCount()};
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <vector>
+
+// Process-wide counters used to spot leaks across sessions and server restarts, -1 if unknown
+struct ResourceUsage
+{
+  long rss = -1; // resident set size in bytes
+  int fds = -1;
+  int threads = -1;
+};
+
+auto resourceUsage() -> ResourceUsage;
+
+// The open file descriptors of this process, read from the fd directory rather than by probing
+// every fd number up to getdtablesize(), which with a raised RLIMIT_NOFILE costs hundreds of
+// thousands of syscalls. Empty if the directory can't be read.
+auto openFileDescriptors() -> std::vector<int>;
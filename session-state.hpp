@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+enum class SessionState { stopped, idle, connected, restarting };
+
+// Session state and the number of open connections in one atomic word. conn_init and
+// conn_destroy run on different raop threads, each of them decides its transition from the count
+// it leaves behind in the same compare-exchange, so a connect racing the last disconnect can not
+// end up counted but idle.
+class Session
+{
+public:
+  struct Snapshot
+  {
+    SessionState state;
+    int connections;
+  };
+
+  auto load() const -> Snapshot { return unpack(word.load(std::memory_order_acquire)); }
+  auto state() const -> SessionState { return load().state; }
+  auto connections() const -> int { return load().connections; }
+
+  // One more connection, an idle session becomes connected. Returns the new count.
+  auto connect() -> int
+  {
+    return update([](Snapshot s) {
+             ++s.connections;
+             if (s.state == SessionState::idle)
+               s.state = SessionState::connected;
+             return s;
+           })
+      .connections;
+  }
+
+  // One connection less, a connected session becomes idle with the last one. A disconnect after a
+  // restart cleared the count leaves it at 0. Returns the new count and whether the session ended.
+  auto disconnect() -> std::pair<int, bool>
+  {
+    auto ended = false;
+    const auto s = update([&](Snapshot s) {
+      ended = false;
+      if (s.connections > 0)
+        --s.connections;
+      if (!s.connections && s.state == SessionState::connected)
+      {
+        s.state = SessionState::idle;
+        ended = true;
+      }
+      return s;
+    });
+    return {s.connections, ended};
+  }
+
+  // Sets the state, the count is kept or cleared
+  auto set(SessionState state, bool clearConnections = false) -> void
+  {
+    update([&](Snapshot s) {
+      s.state = state;
+      if (clearConnections)
+        s.connections = 0;
+      return s;
+    });
+  }
+
+private:
+  static auto pack(Snapshot s) -> uint32_t
+  {
+    return static_cast<uint32_t>(s.connections) << 8 | static_cast<uint32_t>(s.state);
+  }
+  static auto unpack(uint32_t v) -> Snapshot
+  {
+    return {static_cast<SessionState>(v & 0xff), static_cast<int>(v >> 8)};
+  }
+
+  template <typename F>
+  auto update(F f) -> Snapshot
+  {
+    auto v = word.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      const auto next = f(unpack(v));
+      if (word.compare_exchange_weak(v, pack(next), std::memory_order_acq_rel))
+        return next;
+    }
+  }
+
+  std::atomic<uint32_t> word = pack({SessionState::stopped, 0});
+};
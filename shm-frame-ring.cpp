@@ -0,0 +1,324 @@
+#include "shm-frame-ring.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace shm_ring;
+
+static constexpr auto HeaderSize = size_t{4096};
+
+static auto align(size_t v, size_t a) -> size_t
+{
+  return (v + a - 1) / a * a;
+}
+
+ShmFrameWriter::ShmFrameWriter(std::string name, int slots) : shmName(std::move(name)), slots(slots)
+{
+}
+
+ShmFrameWriter::~ShmFrameWriter()
+{
+  close();
+}
+
+// True when the segment under name is open in a live writer, which may be another source or
+// another process configured with the same name
+static auto inUse(const std::string &name) -> bool
+{
+  const auto fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  auto p = fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= HeaderSize
+             ? mmap(nullptr, HeaderSize, PROT_READ, MAP_SHARED, fd, 0)
+             : MAP_FAILED;
+  ::close(fd);
+  if (p == MAP_FAILED)
+    return false;
+  const auto h = static_cast<Header *>(p);
+  const auto live = std::atomic_ref<uint32_t>(h->magic).load(std::memory_order_acquire) == Magic &&
+                    h->version == Version && !h->closed.load(std::memory_order_acquire) &&
+                    (kill(h->writerPid, 0) == 0 || errno == EPERM);
+  munmap(p, HeaderSize);
+  return live;
+}
+
+auto ShmFrameWriter::create(size_t slotSize) -> bool
+{
+  close();
+  if (inUse(shmName))
+  {
+    errno = EBUSY;
+    return false;
+  }
+  // a segment left behind by a crashed writer is replaced, not reused
+  shm_unlink(shmName.c_str());
+  const auto fd = shm_open(shmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0)
+    return false;
+  const auto total = HeaderSize + slots * slotSize;
+  if (ftruncate(fd, total) != 0)
+  {
+    const auto err = errno;
+    ::close(fd);
+    shm_unlink(shmName.c_str());
+    errno = err;
+    return false;
+  }
+  auto p = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED)
+  {
+    shm_unlink(shmName.c_str());
+    return false;
+  }
+  // ftruncate zero fills, the atomics start out as 0
+  header = static_cast<Header *>(p);
+  header->version = Version;
+  header->slots = slots;
+  header->slotSize = slotSize;
+  header->writerPid = getpid();
+  size = total;
+  frame = 0;
+  // readers check the magic last
+  std::atomic_ref<uint32_t>(header->magic).store(Magic, std::memory_order_release);
+  return true;
+}
+
+auto ShmFrameWriter::close() -> void
+{
+  if (!header)
+    return;
+  header->closed.store(1, std::memory_order_release);
+  header->futex.fetch_add(1, std::memory_order_release);
+#ifdef __linux__
+  syscall(SYS_futex, &header->futex, FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+#endif
+  munmap(header, size);
+  shm_unlink(shmName.c_str());
+  header = nullptr;
+  size = 0;
+}
+
+auto ShmFrameWriter::write(int width,
+                           int height,
+                           int format,
+                           std::span<const ShmPlane> planes,
+                           uint64_t timestamp,
+                           uint64_t pts) -> bool
+{
+  if (planes.size() > MaxPlanes)
+    return false;
+  auto needed = align(sizeof(SlotHeader), 64);
+  for (const auto &p : planes)
+    needed += align(static_cast<size_t>(p.linesize) * p.rows, 64);
+  if (!header || needed > header->slotSize)
+  {
+    // headroom, so a slightly larger picture does not recreate the segment again
+    if (!create(align(needed + needed / 4, 4096)))
+      return false;
+  }
+
+  const auto number = ++frame;
+  auto slot = reinterpret_cast<SlotHeader *>(reinterpret_cast<uint8_t *>(header) + HeaderSize +
+                                             (number % header->slots) * header->slotSize);
+  // seqlock: readers that still use the old frame see it invalidated before the data changes
+  slot->frame.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot->timestamp = timestamp;
+  slot->pts = pts;
+  slot->width = width;
+  slot->height = height;
+  slot->format = format;
+  slot->planes = planes.size();
+  auto offset = align(sizeof(SlotHeader), 64);
+  for (auto i = 0U; i < planes.size(); ++i)
+  {
+    const auto bytes = static_cast<size_t>(planes[i].linesize) * planes[i].rows;
+    memcpy(reinterpret_cast<uint8_t *>(slot) + offset, planes[i].data, bytes);
+    slot->linesize[i] = planes[i].linesize;
+    slot->offset[i] = offset;
+    slot->rows[i] = planes[i].rows;
+    offset += align(bytes, 64);
+  }
+  slot->frame.store(number, std::memory_order_release);
+  header->written.store(number, std::memory_order_release);
+  header->futex.store(static_cast<uint32_t>(number), std::memory_order_release);
+#ifdef __linux__
+  // the wake is a syscall, skipped while nobody waits
+  if (header->waiters.load(std::memory_order_acquire))
+    syscall(SYS_futex, &header->futex, FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+#endif
+  return true;
+}
+
+ShmFrameReader::ShmFrameReader(std::string name) : shmName(std::move(name))
+{
+  open();
+}
+
+ShmFrameReader::~ShmFrameReader()
+{
+  close();
+}
+
+auto ShmFrameReader::open() -> bool
+{
+  const auto fd = shm_open(shmName.c_str(), O_RDWR, 0);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < HeaderSize)
+  {
+    ::close(fd);
+    return false;
+  }
+  // writable for the waiter count, frames are only read
+  auto p = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED)
+    return false;
+  auto h = static_cast<Header *>(p);
+  if (std::atomic_ref<uint32_t>(h->magic).load(std::memory_order_acquire) != Magic ||
+      h->version != Version || h->closed.load(std::memory_order_acquire) || !h->slots ||
+      h->slotSize < sizeof(SlotHeader) ||
+      HeaderSize + static_cast<size_t>(h->slots) * h->slotSize > static_cast<size_t>(st.st_size))
+  {
+    munmap(p, st.st_size);
+    return false;
+  }
+  header = h;
+  size = st.st_size;
+  // frame numbers start over in a new segment, reading starts with its newest frame
+  const auto written = header->written.load(std::memory_order_acquire);
+  lastFrame = written ? written - 1 : 0;
+  return true;
+}
+
+auto ShmFrameReader::close() -> void
+{
+  if (!header)
+    return;
+  munmap(header, size);
+  header = nullptr;
+  size = 0;
+}
+
+auto ShmFrameReader::slot(uint64_t frame) const -> SlotHeader *
+{
+  return reinterpret_cast<SlotHeader *>(reinterpret_cast<uint8_t *>(header) + HeaderSize +
+                                        (frame % header->slots) * header->slotSize);
+}
+
+// The plane lies between the slot header and the end of the slot
+auto ShmFrameReader::planeFits(uint32_t offset, int linesize, int rows) const -> bool
+{
+  if (linesize <= 0 || rows < 0 || offset < sizeof(SlotHeader))
+    return false;
+  return uint64_t{offset} + static_cast<uint64_t>(linesize) * static_cast<uint64_t>(rows) <=
+         header->slotSize;
+}
+
+auto ShmFrameReader::wait(uint32_t value, std::chrono::milliseconds timeout) -> void
+{
+#ifdef __linux__
+  const auto ts = timespec{static_cast<time_t>(timeout.count() / 1000),
+                           static_cast<long>(timeout.count() % 1000 * 1'000'000)};
+  header->waiters.fetch_add(1, std::memory_order_acq_rel);
+  syscall(SYS_futex, &header->futex, FUTEX_WAIT, value, &ts, nullptr, 0);
+  header->waiters.fetch_sub(1, std::memory_order_acq_rel);
+#else
+  (void)value;
+  std::this_thread::sleep_for(std::min(timeout, std::chrono::milliseconds{1}));
+#endif
+}
+
+auto ShmFrameReader::next(std::chrono::milliseconds timeout) -> std::optional<ShmFrame>
+{
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  for (;;)
+  {
+    const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+      deadline - std::chrono::steady_clock::now());
+    if (header && header->closed.load(std::memory_order_acquire))
+      close();
+    if (!header && !open())
+    {
+      if (left.count() <= 0)
+        return std::nullopt;
+      // no writer yet, or it is replacing the segment
+      std::this_thread::sleep_for(std::min(left, std::chrono::milliseconds{10}));
+      continue;
+    }
+
+    const auto futex = header->futex.load(std::memory_order_acquire);
+    const auto written = header->written.load(std::memory_order_acquire);
+    if (written > lastFrame)
+    {
+      auto wanted = lastFrame + 1;
+      // the slot after the newest one may already be refilled, it is skipped as well
+      if (written - wanted + 1 >= header->slots)
+      {
+        const auto oldest = written - header->slots + 2;
+        droppedFrames += oldest - wanted;
+        wanted = oldest;
+      }
+      const auto s = slot(wanted);
+      if (s->frame.load(std::memory_order_acquire) == wanted)
+      {
+        ShmFrame f;
+        f.frame = wanted;
+        f.timestamp = s->timestamp;
+        f.pts = s->pts;
+        f.width = s->width;
+        f.height = s->height;
+        f.format = s->format;
+        f.planes = s->planes;
+        auto fits = f.planes >= 0 && f.planes <= MaxPlanes;
+        for (auto i = 0; i < MaxPlanes; ++i)
+        {
+          const auto used = i < f.planes;
+          f.data[i] = used ? reinterpret_cast<const uint8_t *>(s) + s->offset[i] : nullptr;
+          f.linesize[i] = used ? s->linesize[i] : 0;
+          f.rows[i] = used ? s->rows[i] : 0;
+          if (used && fits)
+            fits = planeFits(s->offset[i], f.linesize[i], f.rows[i]);
+        }
+        lastFrame = wanted;
+        // a torn read of a slot being rewritten fails valid() as well
+        if (!valid(f))
+          continue;
+        if (fits)
+          return f;
+        ++droppedFrames;
+        continue;
+      }
+      // overwritten between reading written and the slot, try again with the newer state
+      ++droppedFrames;
+      lastFrame = wanted;
+      continue;
+    }
+    if (left.count() <= 0)
+      return std::nullopt;
+    wait(futex, left);
+  }
+}
+
+auto ShmFrameReader::valid(const ShmFrame &f) const -> bool
+{
+  if (!header)
+    return false;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot(f.frame)->frame.load(std::memory_order_relaxed) == f.frame;
+}
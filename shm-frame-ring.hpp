@@ -0,0 +1,141 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+
+// Ring of decoded pictures in POSIX shared memory, written by the plugin and read by other local
+// processes. The writer copies each picture once into a slot, readers get pointers into the
+// mapping and copy nothing. New frames are signalled through a futex in the segment on Linux,
+// readers poll elsewhere. This header and shm-frame-ring.cpp have no OBS or FFmpeg dependency and
+// can be built into a reader on their own.
+//
+// Segment layout: ShmRingHeader, then `slots` slots of `slotSize` bytes, each one a ShmSlotHeader
+// followed by the planes. When the picture no longer fits the writer marks the segment closed,
+// unlinks it and creates a new one under the same name, readers reopen it by themselves. A writer
+// does not take over a segment another live writer still uses, write() fails with EBUSY then.
+
+namespace shm_ring
+{
+  constexpr uint32_t Magic = 0x4f415046; // "OAPF"
+  constexpr uint32_t Version = 3;
+  constexpr auto MaxPlanes = 4;
+
+  struct alignas(64) Header
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots;
+    uint32_t slotSize;
+    // process that writes the segment, a segment that is not closed is only replaced once this
+    // process is gone
+    int32_t writerPid;
+    // number of the latest complete frame, frames are numbered from 1
+    std::atomic<uint64_t> written;
+    // low 32 bits of written, the futex readers wait on
+    std::atomic<uint32_t> futex;
+    std::atomic<uint32_t> waiters;
+    std::atomic<uint32_t> closed;
+  };
+
+  struct alignas(64) SlotHeader
+  {
+    // frame number held by the slot, 0 while the writer fills it
+    std::atomic<uint64_t> frame;
+    uint64_t timestamp; // OBS clock, ns
+    uint64_t pts;       // sender clock, us
+    int32_t width;
+    int32_t height;
+    int32_t format; // AVPixelFormat
+    int32_t planes;
+    std::array<int32_t, MaxPlanes> linesize;
+    std::array<uint32_t, MaxPlanes> offset; // from the start of the slot
+    std::array<int32_t, MaxPlanes> rows;
+  };
+
+  static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                  std::atomic<uint32_t>::is_always_lock_free,
+                "shared memory atomics must be address free");
+} // namespace shm_ring
+
+struct ShmPlane
+{
+  const uint8_t *data;
+  int linesize;
+  int rows;
+};
+
+class ShmFrameWriter
+{
+public:
+  explicit ShmFrameWriter(std::string name, int slots = 4);
+  ~ShmFrameWriter();
+  ShmFrameWriter(const ShmFrameWriter &) = delete;
+  auto operator=(const ShmFrameWriter &) -> ShmFrameWriter & = delete;
+  // Copies the planes into the next slot and wakes the readers. The segment is (re)created when
+  // the picture does not fit.
+  auto write(int width,
+             int height,
+             int format,
+             std::span<const ShmPlane> planes,
+             uint64_t timestamp,
+             uint64_t pts) -> bool;
+  auto name() const -> const std::string & { return shmName; }
+
+private:
+  auto create(size_t slotSize) -> bool;
+  auto close() -> void;
+
+  std::string shmName;
+  int slots;
+  size_t size = 0;
+  shm_ring::Header *header = nullptr;
+  uint64_t frame = 0;
+};
+
+struct ShmFrame
+{
+  uint64_t frame;
+  uint64_t timestamp;
+  uint64_t pts;
+  int width;
+  int height;
+  int format;
+  int planes;
+  std::array<const uint8_t *, shm_ring::MaxPlanes> data;
+  std::array<int, shm_ring::MaxPlanes> linesize;
+  std::array<int, shm_ring::MaxPlanes> rows;
+};
+
+class ShmFrameReader
+{
+public:
+  explicit ShmFrameReader(std::string name);
+  ~ShmFrameReader();
+  ShmFrameReader(const ShmFrameReader &) = delete;
+  auto operator=(const ShmFrameReader &) -> ShmFrameReader & = delete;
+  // Waits up to timeout for a frame newer than the last one returned. Readers that fall more than
+  // a ring behind skip to the oldest frame still held, the skipped ones are counted as dropped, as
+  // are frames whose planes would reach past their slot.
+  // The frame points into the shared memory and stays there until the writer wraps around.
+  auto next(std::chrono::milliseconds timeout) -> std::optional<ShmFrame>;
+  // True when the writer has not started overwriting the frame yet, check after using its data
+  auto valid(const ShmFrame &) const -> bool;
+  auto dropped() const -> uint64_t { return droppedFrames; }
+
+private:
+  auto open() -> bool;
+  auto close() -> void;
+  auto slot(uint64_t frame) const -> shm_ring::SlotHeader *;
+  auto planeFits(uint32_t offset, int linesize, int rows) const -> bool;
+  auto wait(uint32_t value, std::chrono::milliseconds timeout) -> void;
+
+  std::string shmName;
+  size_t size = 0;
+  shm_ring::Header *header = nullptr;
+  uint64_t lastFrame = 0;
+  uint64_t droppedFrames = 0;
+};
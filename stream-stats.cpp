@@ -0,0 +1,207 @@
+#include "stream-stats.hpp"
+#include "async-log.hpp"
+#include <algorithm>
+
+// Exp-Golomb ue(v) at bit pos of data, -1 when the data ends first. Slice headers start right
+// after the NAL header, emulation prevention bytes cannot occur in the few bits read here.
+static auto readUe(std::span<const uint8_t> data, size_t &pos) -> int
+{
+  auto bit = [&]() -> int {
+    if (pos >= data.size() * 8)
+      return -1;
+    const auto b = (data[pos / 8] >> (7 - pos % 8)) & 1;
+    ++pos;
+    return b;
+  };
+  auto zeros = 0;
+  for (;;)
+  {
+    const auto b = bit();
+    if (b < 0 || zeros > 16)
+      return -1;
+    if (b)
+      break;
+    ++zeros;
+  }
+  auto value = 0;
+  for (auto i = 0; i < zeros; ++i)
+  {
+    const auto b = bit();
+    if (b < 0)
+      return -1;
+    value = (value << 1) | b;
+  }
+  return (1 << zeros) - 1 + value;
+}
+
+static auto hash(std::span<const uint8_t> data) -> uint64_t
+{
+  auto h = uint64_t{14695981039346656037ULL};
+  for (const auto v : data)
+    h = (h ^ v) * 1099511628211ULL;
+  return h;
+}
+
+auto StreamStats::packet(std::span<const uint8_t> data, int64_t now) -> void
+{
+  if (!start)
+    start = now;
+  bytes += data.size();
+  maxPacket = std::max(maxPacket, static_cast<int64_t>(data.size()));
+
+  auto first = true;
+  auto vcl = false;
+  auto idr = false;
+  forEachNal(data, [&](std::span<const uint8_t> nal) {
+    if (first && nal.size() >= 2)
+    {
+      first = false;
+      if (const auto detected = detectCodec(nal[0], nal[1]))
+        codec = *detected;
+    }
+    const auto type = classify(codec, nal[0]);
+    switch (type)
+    {
+    case Nal::sps: {
+      const auto h = hash(nal);
+      if (spsHash && h != spsHash)
+        ++spsChanges;
+      spsHash = h;
+      break;
+    }
+    case Nal::idr:
+    case Nal::slice: {
+      vcl = true;
+      idr = idr || type == Nal::idr;
+      if (codec == VideoCodec::hevc)
+      {
+        // the HEVC slice type sits behind fields sized by the PPS, IRAP pictures are intra
+        ++(type == Nal::idr ? slicesI : slicesP);
+        break;
+      }
+      auto pos = size_t{};
+      const auto header = nal.subspan(1, std::min<size_t>(nal.size() - 1, 8));
+      if (readUe(header, pos) < 0) // first_mb_in_slice
+        break;
+      switch (readUe(header, pos) % 5)
+      {
+      case 0:
+      case 3: ++slicesP; break;
+      case 1: ++slicesB; break;
+      case 2:
+      case 4: ++slicesI; break;
+      }
+      break;
+    }
+    case Nal::vps:
+    case Nal::pps:
+    case Nal::other: break;
+    }
+  });
+
+  if (!vcl)
+    return;
+  ++frames;
+  if (idr)
+  {
+    ++idrFrames;
+    if (framesSinceIdr)
+    {
+      gopFrames += framesSinceIdr;
+      ++gops;
+    }
+    framesSinceIdr = 0;
+  }
+  ++framesSinceIdr;
+}
+
+auto StreamStats::decodeTime(int64_t ns) -> void
+{
+  ++decodes;
+  decodeNs += ns;
+  maxDecodeNs = std::max(maxDecodeNs, ns);
+}
+
+auto StreamStats::refreshTime(int64_t ns) -> void
+{
+  ++refreshes;
+  refreshNs += ns;
+}
+
+auto StreamStats::report(int64_t now, int64_t interval) -> void
+{
+  const auto elapsed = now - start;
+  if (!start || elapsed < interval)
+    return;
+  const auto seconds = elapsed / 1e9;
+  last.codec = codec;
+  last.kbps = static_cast<int64_t>(bytes * 8 / seconds / 1000);
+  last.fps = frames / seconds;
+  last.maxPacket = maxPacket;
+  last.idrFrames = idrFrames;
+  last.gop = gops ? gopFrames / gops : framesSinceIdr;
+  last.spsChanges = spsChanges;
+  last.slicesI = slicesI;
+  last.slicesP = slicesP;
+  last.slicesB = slicesB;
+  last.decodes = decodes;
+  last.decodeAvgUs = decodes ? decodeNs / decodes / 1000 : 0;
+  last.decodeMaxUs = maxDecodeNs / 1000;
+  last.refreshes = refreshes;
+  last.refreshAvgUs = refreshes ? refreshNs / refreshes / 1000 : 0;
+
+  ALOG(video,
+       info,
+       codec == VideoCodec::hevc ? "HEVC" : "H.264",
+       "stream:",
+       last.kbps,
+       "kbit/s,",
+       last.fps,
+       "fps, largest packet",
+       last.maxPacket,
+       "bytes,",
+       last.idrFrames,
+       "IDR frames, GOP",
+       last.gop,
+       "frames, SPS changes",
+       last.spsChanges);
+  if (codec == VideoCodec::hevc)
+    ALOG(video, info, "Slices: intra", slicesI, "inter", slicesP);
+  else
+    ALOG(video, info, "Slices: I", slicesI, "P", slicesP, "B", slicesB);
+  ALOG(video,
+       info,
+       "Decode and convert:",
+       last.decodes,
+       "packets, avg",
+       last.decodeAvgUs,
+       "us, max",
+       last.decodeMaxUs,
+       "us, held back pictures refreshed",
+       last.refreshes,
+       "avg",
+       last.refreshAvgUs,
+       "us");
+
+  start = now;
+  bytes = 0;
+  maxPacket = 0;
+  frames = 0;
+  idrFrames = 0;
+  gopFrames = 0;
+  gops = 0;
+  slicesI = 0;
+  slicesP = 0;
+  slicesB = 0;
+  spsChanges = 0;
+  decodes = 0;
+  decodeNs = 0;
+  maxDecodeNs = 0;
+  refreshes = 0;
+  refreshNs = 0;
+}
+
+auto StreamStats::reset() -> void
+{
+  *this = StreamStats{};
+}
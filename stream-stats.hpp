@@ -0,0 +1,69 @@
+#pragma once
+#include "annex-b.hpp"
+#include <cstdint>
+#include <span>
+
+// Figures of the last completed interval
+struct StreamReport
+{
+  VideoCodec codec = VideoCodec::h264;
+  int64_t kbps = 0;
+  double fps = 0;
+  int64_t maxPacket = 0;
+  int idrFrames = 0;
+  int64_t gop = 0;
+  int spsChanges = 0;
+  int slicesI = 0;
+  int slicesP = 0;
+  int slicesB = 0;
+  int decodes = 0;
+  int64_t decodeAvgUs = 0;
+  int64_t decodeMaxUs = 0;
+  int refreshes = 0;
+  int64_t refreshAvgUs = 0;
+};
+
+// Rolling statistics of the incoming mirroring stream. Only NAL unit headers and the first bytes
+// of slice headers are read, nothing is copied or decoded. Not thread safe, the owner guards it
+// with the decoder lock.
+class StreamStats
+{
+public:
+  // data is one Annex B access unit, now is the arrival time in ns
+  auto packet(std::span<const uint8_t> data, int64_t now) -> void;
+  // time the decoder spent on the packet, conversion included
+  auto decodeTime(int64_t ns) -> void;
+  // time spent converting a picture held back by the decoder when it was output later
+  auto refreshTime(int64_t ns) -> void;
+  // Logs the counters gathered since the last report once interval ns have passed, keeps them as
+  // the last report and starts a new interval
+  auto report(int64_t now, int64_t interval) -> void;
+  auto lastReport() const -> const StreamReport & { return last; }
+  // Starts over for a new session
+  auto reset() -> void;
+
+private:
+  VideoCodec codec = VideoCodec::h264;
+  int64_t start = 0;
+  uint64_t spsHash = 0;
+  int framesSinceIdr = 0;
+
+  // counters of the current interval
+  int64_t bytes = 0;
+  int64_t maxPacket = 0;
+  int frames = 0;
+  int idrFrames = 0;
+  int64_t gopFrames = 0;
+  int gops = 0;
+  int slicesI = 0;
+  int slicesP = 0;
+  int slicesB = 0;
+  int spsChanges = 0;
+  int decodes = 0;
+  int64_t decodeNs = 0;
+  int64_t maxDecodeNs = 0;
+  int refreshes = 0;
+  int64_t refreshNs = 0;
+
+  StreamReport last;
+};
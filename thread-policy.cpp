@@ -0,0 +1,182 @@
+#include "thread-policy.hpp"
+#include "async-log.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <sys/resource.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+auto parseCpuList(const std::string &str) -> std::vector<int>
+{
+  std::vector<int> ret;
+  std::istringstream ss(str);
+  std::string item;
+  while (std::getline(ss, item, ','))
+  {
+    int first, last;
+    char dash;
+    std::istringstream is(item);
+    if (!(is >> first) || first < 0)
+      continue;
+    if (!(is >> dash))
+    {
+      ret.push_back(first);
+      continue;
+    }
+    // "9-7" or "3-x" is dropped as a whole, not read as its first CPU
+    if (dash != '-' || !(is >> last) || last < first)
+      continue;
+    for (auto cpu = first; cpu <= last; ++cpu)
+      ret.push_back(cpu);
+  }
+  return ret;
+}
+
+// What the threads started with, restored when the policy goes back to the default. Captured
+// when the plugin is loaded, before any thread is pinned or reprioritised.
+struct DefaultPolicy
+{
+  DefaultPolicy()
+  {
+#ifdef __linux__
+    CPU_ZERO(&cpus);
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) != 0)
+      for (auto cpu = 0L; cpu < std::min(sysconf(_SC_NPROCESSORS_CONF), long{CPU_SETSIZE}); ++cpu)
+        CPU_SET(cpu, &cpus);
+#endif
+    errno = 0;
+    nice = getpriority(PRIO_PROCESS, 0);
+    if (errno)
+      nice = 0;
+    if (pthread_getschedparam(pthread_self(), &policy, &param) != 0)
+    {
+      policy = SCHED_OTHER;
+      param = {};
+    }
+  }
+
+#ifdef __linux__
+  cpu_set_t cpus;
+#endif
+  int nice;
+  int policy;
+  sched_param param;
+};
+
+static const DefaultPolicy defaultPolicy;
+
+static auto restoreScheduler(const char *name) -> bool
+{
+  if (const auto err =
+        pthread_setschedparam(pthread_self(), defaultPolicy.policy, &defaultPolicy.param))
+  {
+    ALOG(session, warning, name, "could not restore the default scheduler:", strerror(err));
+    return false;
+  }
+  return true;
+}
+
+#ifdef __linux__
+static auto setNice(const char *name, int nice) -> bool
+{
+  // on Linux the nice value is per thread
+  if (setpriority(PRIO_PROCESS, syscall(SYS_gettid), nice) != 0)
+  {
+    ALOG(session, warning, name, "could not set the nice value to", nice, ":", strerror(errno));
+    return false;
+  }
+  return true;
+}
+#endif
+
+auto nameThread(const char *name) -> void
+{
+#ifdef __linux__
+  pthread_setname_np(pthread_self(), name);
+#else
+  pthread_setname_np(name);
+#endif
+}
+
+auto applyThreadPolicy(const char *name, const ThreadPolicy &policy) -> bool
+{
+  auto ok = true;
+  nameThread(name);
+
+#ifdef __linux__
+  auto set = defaultPolicy.cpus;
+  if (!policy.cpus.empty())
+  {
+    CPU_ZERO(&set);
+    for (auto cpu : policy.cpus)
+      if (cpu < CPU_SETSIZE)
+        CPU_SET(cpu, &set);
+  }
+  if (const auto err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+  {
+    ALOG(session,
+         warning,
+         name,
+         policy.cpus.empty() ? "could not restore its CPU affinity:"
+                             : "could not be pinned to the requested CPUs:",
+         strerror(err));
+    ok = false;
+  }
+#else
+  if (!policy.cpus.empty())
+  {
+    ALOG(session, warning, name, "CPU pinning is not supported on this OS");
+    ok = false;
+  }
+#endif
+
+  switch (policy.priority)
+  {
+  case ThreadPriority::normal:
+    ok = restoreScheduler(name) && ok;
+#ifdef __linux__
+    ok = setNice(name, defaultPolicy.nice) && ok;
+#endif
+    break;
+  case ThreadPriority::realtime: {
+    sched_param param = {};
+    param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 1;
+    const auto err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (!err)
+      break;
+    ALOG(session,
+         warning,
+         name,
+         "SCHED_FIFO not permitted (",
+         strerror(err),
+         "), falling back to high priority");
+    ok = false;
+  }
+    [[fallthrough]];
+  case ThreadPriority::high:
+#ifdef __linux__
+    // leaves SCHED_FIFO when switching down from realtime
+    if (policy.priority == ThreadPriority::high)
+      ok = restoreScheduler(name) && ok;
+    ok = setNice(name, -10) && ok;
+#else
+    {
+      sched_param param = {};
+      param.sched_priority = sched_get_priority_max(SCHED_OTHER);
+      if (const auto err = pthread_setschedparam(pthread_self(), SCHED_OTHER, &param))
+      {
+        ALOG(session, warning, name, "could not raise the priority:", strerror(err));
+        ok = false;
+      }
+    }
+#endif
+    break;
+  }
+  return ok;
+}
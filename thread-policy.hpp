@@ -0,0 +1,20 @@
+#pragma once
+#include <string>
+#include <vector>
+
+enum class ThreadPriority { normal, high, realtime };
+
+struct ThreadPolicy
+{
+  std::vector<int> cpus; // empty: no pinning
+  ThreadPriority priority = ThreadPriority::normal;
+  auto isDefault() const -> bool { return cpus.empty() && priority == ThreadPriority::normal; }
+};
+
+// "2,3" or "4-7" style list, invalid entries and reversed ranges are ignored
+auto parseCpuList(const std::string &) -> std::vector<int>;
+auto nameThread(const char *name) -> void;
+// Names the calling thread and applies the policy to it. Threads it creates afterwards inherit
+// the affinity and scheduling policy. No CPUs and normal priority restore the affinity, scheduler
+// and nice value the process was loaded with. Returns false and logs what could not be applied.
+auto applyThreadPolicy(const char *name, const ThreadPolicy &) -> bool;
@@ -0,0 +1,133 @@
+// Checks the H.264 and HEVC handling of the video path. The Annex B parsing is checked against
+// hand-made NAL headers. Recordings given on the command line are decoded through VideoDecoder,
+// which has to pick the codec from the stream, and once more after a flush, resuming from an IDR
+// frame whose parameter sets were stripped so the cached ones have to be prepended. Exits with 1
+// on a failed check.
+#include "../../video-decoder.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+static auto failures = 0;
+
+static auto check(bool ok, const char *what, const char *where = "") -> void
+{
+  if (ok)
+    return;
+  fprintf(stderr, "FAILED: %s %s\n", what, where);
+  ++failures;
+}
+
+static auto parsing() -> void
+{
+  // H.264: SPS 0x67, PPS 0x68, IDR 0x65, non-IDR slice 0x41
+  check(detectCodec(0x67, 0x42) == VideoCodec::h264, "H.264 SPS detected");
+  check(classify(VideoCodec::h264, 0x67) == Nal::sps, "H.264 SPS");
+  check(classify(VideoCodec::h264, 0x68) == Nal::pps, "H.264 PPS");
+  check(classify(VideoCodec::h264, 0x65) == Nal::idr, "H.264 IDR");
+  check(classify(VideoCodec::h264, 0x41) == Nal::slice, "H.264 slice");
+  // HEVC: the type is in bits 1-6 of the first header byte
+  check(detectCodec(0x40, 0x01) == VideoCodec::hevc, "HEVC VPS detected");
+  check(classify(VideoCodec::hevc, 32 << 1) == Nal::vps, "HEVC VPS");
+  check(classify(VideoCodec::hevc, 33 << 1) == Nal::sps, "HEVC SPS");
+  check(classify(VideoCodec::hevc, 34 << 1) == Nal::pps, "HEVC PPS");
+  check(classify(VideoCodec::hevc, 19 << 1) == Nal::idr, "HEVC IDR_W_RADL");
+  check(classify(VideoCodec::hevc, 20 << 1) == Nal::idr, "HEVC IDR_N_LP");
+  check(classify(VideoCodec::hevc, 21 << 1) == Nal::idr, "HEVC CRA");
+  check(classify(VideoCodec::hevc, 1 << 1) == Nal::slice, "HEVC TRAIL_R");
+  check(classify(VideoCodec::hevc, 39 << 1) == Nal::other, "HEVC SEI");
+  check(!detectCodec(0x41, 0x9a), "no codec from a slice");
+
+  // 3 and 4-byte start codes, the zero before a 4-byte one is not part of the NAL
+  const uint8_t stream[] = {0, 0, 1, 0x40, 0x01, 0, 0, 0, 1, 0x42, 0x01, 0x07, 0, 0, 1, 0x44};
+  std::vector<std::vector<uint8_t>> nals;
+  forEachNal(stream,
+             [&](std::span<const uint8_t> nal) { nals.emplace_back(nal.begin(), nal.end()); });
+  check(nals.size() == 3 && nals[0].size() == 2 && nals[1].size() == 3 && nals[2].size() == 1,
+        "NAL units split at the start codes");
+}
+
+static auto isParameterSet(VideoCodec codec, uint8_t header) -> bool
+{
+  const auto type = classify(codec, header);
+  return type == Nal::vps || type == Nal::sps || type == Nal::pps;
+}
+
+// Pictures decode() produced, converted or held back as unchanged
+static auto decodeAll(VideoDecoder &decoder, const std::vector<std::vector<uint8_t>> &units)
+  -> int
+{
+  auto pictures = 0;
+  for (const auto &unit : units)
+    if (decoder.decode(unit) || decoder.pending())
+      ++pictures;
+  return pictures;
+}
+
+static auto recording(const char *path) -> void
+{
+  std::ifstream file(path, std::ios::binary);
+  const auto stream = std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {});
+  const auto units = accessUnits(stream);
+  auto codec = std::optional<VideoCodec>{};
+  forEachNal(stream, [&](std::span<const uint8_t> nal) {
+    if (!codec && nal.size() > 1)
+      codec = detectCodec(nal[0], nal[1]);
+  });
+  check(!units.empty() && codec.has_value(), "parameter sets found in", path);
+  if (units.empty() || !codec)
+    return;
+
+  VideoDecoder decoder;
+  const auto pictures = decodeAll(decoder, units);
+  check(pictures > 0, "pictures decoded from", path);
+
+  // resume from the last IDR frame that is not the first, without its parameter sets
+  auto idr = units.size();
+  for (auto i = units.size() - 1; i > 0 && idr == units.size(); --i)
+    forEachNal(units[i], [&](std::span<const uint8_t> nal) {
+      if (classify(*codec, nal[0]) == Nal::idr)
+        idr = i;
+    });
+  auto resumed = 0;
+  if (idr < units.size())
+  {
+    std::vector<std::vector<uint8_t>> tail;
+    for (auto i = idr; i < units.size(); ++i)
+    {
+      tail.emplace_back();
+      forEachNal(units[i], [&](std::span<const uint8_t> nal) {
+        if (isParameterSet(*codec, nal[0]))
+          return;
+        const uint8_t startCode[] = {0, 0, 0, 1};
+        tail.back().insert(tail.back().end(), std::begin(startCode), std::end(startCode));
+        tail.back().insert(tail.back().end(), nal.begin(), nal.end());
+      });
+    }
+    decoder.flush();
+    resumed = decodeAll(decoder, tail);
+    check(resumed > 0, "pictures after a flush with the parameter sets stripped from", path);
+  }
+  printf("%s: %s, %zu packets, %d pictures, %d after the flush\n",
+         path,
+         *codec == VideoCodec::hevc ? "HEVC" : "H.264",
+         units.size(),
+         pictures,
+         resumed);
+}
+
+int main(int argc, char **argv)
+{
+  parsing();
+  for (auto i = 1; i < argc; ++i)
+    recording(argv[i]);
+  if (failures)
+  {
+    fprintf(stderr, "%d failures\n", failures);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
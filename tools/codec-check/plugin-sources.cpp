@@ -0,0 +1,2 @@
+#include "../../async-log.cpp"
+#include "../../video-decoder.cpp"
@@ -0,0 +1,169 @@
+// Checks PcmProcessor against a plain scalar reference and benchmarks its kernels. Exits with 1
+// on the first mismatch.
+#include "../../pcm-processor.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// Straightforward model of the documented behaviour, no restrict, no special cases
+struct Reference
+{
+  int32_t gain = PcmProcessor::Unity;
+
+  static auto gainFor(float db) -> int32_t
+  {
+    if (db <= -144.0f)
+      return 0;
+    return static_cast<int32_t>(
+      std::lround(std::pow(10.0f, std::min(db, 0.0f) / 20.0f) * PcmProcessor::Unity));
+  }
+
+  auto process(std::vector<int16_t> &samples, int channels, int32_t target) -> bool
+  {
+    const auto frames = samples.size() / channels;
+    for (auto f = size_t{0}; f < frames; ++f)
+    {
+      // linear from the old gain to the target, reaching it on the last frame
+      const auto g = target == gain ? gain
+                                    : gain + static_cast<int32_t>(int64_t{target - gain} *
+                                                                  static_cast<int64_t>(f + 1) /
+                                                                  static_cast<int64_t>(frames));
+      for (auto c = 0; c < channels; ++c)
+      {
+        auto &s = samples[f * channels + c];
+        s = static_cast<int16_t>(std::clamp((s * g) >> 15, -32768, 32767));
+      }
+    }
+    gain = target;
+    return std::all_of(samples.begin(), samples.end(), [](int16_t s) { return s == 0; });
+  }
+};
+
+static auto failures = 0;
+
+static auto check(bool ok, const char *what, int step) -> void
+{
+  if (ok)
+    return;
+  fprintf(stderr, "FAILED: %s at step %d\n", what, step);
+  ++failures;
+}
+
+static auto randomBuffer(std::mt19937 &rng, size_t n, bool silent) -> std::vector<int16_t>
+{
+  std::vector<int16_t> ret(n);
+  if (silent)
+    return ret;
+  std::uniform_int_distribution<int> dist(-32768, 32767);
+  for (auto &s : ret)
+    s = dist(rng);
+  // full scale samples exercise the saturation
+  ret[0] = -32768;
+  ret[n - 1] = 32767;
+  return ret;
+}
+
+static auto correctness() -> void
+{
+  std::mt19937 rng(1);
+  const float volumes[] = {0.0f, -6.0f, -6.0f, -20.0f, -30.0f, -144.0f, -144.0f, -0.5f, 0.0f};
+  for (const auto channels : {1, 2})
+    for (const auto frames : {1, 2, 3, 480, 1024, 4096})
+    {
+      PcmProcessor pcm;
+      Reference ref;
+      auto step = 0;
+      for (const auto db : volumes)
+        for (const auto silent : {false, true, false})
+        {
+          ++step;
+          pcm.setVolume(db);
+          auto a = randomBuffer(rng, frames * channels, silent);
+          auto b = a;
+          const auto silentA = pcm.process(a, channels);
+          const auto silentB = ref.process(b, channels, Reference::gainFor(db));
+          check(a == b, "samples differ from the reference", step);
+          check(silentA == silentB, "silence flag differs from the reference", step);
+        }
+    }
+
+  // the ramp ends exactly on the gain the following buffers use
+  for (const auto frames : {3, 480, 4096})
+  {
+    PcmProcessor pcm;
+    pcm.setVolume(-6.0f);
+    std::vector<int16_t> ramp(frames, 10000);
+    pcm.process(ramp, 1);
+    std::vector<int16_t> steady(1, 10000);
+    pcm.process(steady, 1);
+    check(ramp.back() == steady[0], "ramp does not end on the target gain", frames);
+  }
+}
+
+template <typename F>
+static auto bench(const char *name, size_t samples, F f) -> void
+{
+  constexpr auto Iterations = 20000;
+  for (auto i = 0; i < 100; ++i)
+    f();
+  const auto start = std::chrono::steady_clock::now();
+  for (auto i = 0; i < Iterations; ++i)
+    f();
+  const auto ns =
+    std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+    Iterations;
+  printf("%-28s %8.1f ns/buffer %8.0f Msamples/s\n", name, ns, samples / ns * 1000);
+}
+
+static auto benchmarks() -> void
+{
+  std::mt19937 rng(2);
+  for (const auto frames : {480, 4096})
+  {
+    printf("%d stereo frames\n", frames);
+    const auto n = static_cast<size_t>(frames) * 2;
+    const auto input = randomBuffer(rng, n, false);
+    auto buf = input;
+
+    PcmProcessor unity;
+    bench("unity (silence check only)", n, [&]() { unity.process(buf, 2); });
+
+    // gain and ramp include restoring the input, a memcpy of the buffer
+    PcmProcessor gain;
+    gain.setVolume(-6.0f);
+    gain.process(buf, 2);
+    bench("gain", n, [&]() {
+      buf = input;
+      gain.process(buf, 2);
+    });
+
+    PcmProcessor ramp;
+    auto db = 0.0f;
+    bench("ramp", n, [&]() {
+      buf = input;
+      db = db == 0.0f ? -6.0f : 0.0f;
+      ramp.setVolume(db);
+      ramp.process(buf, 2);
+    });
+
+    std::vector<int16_t> silence(n);
+    PcmProcessor silent;
+    bench("silent buffer", n, [&]() { silent.process(silence, 2); });
+  }
+}
+
+int main()
+{
+  correctness();
+  if (failures)
+  {
+    fprintf(stderr, "%d failures\n", failures);
+    return 1;
+  }
+  printf("ok: PcmProcessor matches the scalar reference\n");
+  benchmarks();
+  return 0;
+}
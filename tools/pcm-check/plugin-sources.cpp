@@ -0,0 +1 @@
+#include "../../pcm-processor.cpp"
@@ -0,0 +1,186 @@
+// Connect/disconnect/restart stress test of the AirPlay session state machine. Device threads
+// open and close connections through the raop callbacks while the server restarts underneath
+// them and a video thread keeps feeding render(), nothing serialises them. Built with
+// ThreadSanitizer (see coddle.toml), which reports data races by itself, the test exits with 1
+// when a state invariant breaks. Needs a running mDNS responder for the raop server.
+#include "../../airplay.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <obs/obs.h>
+#include <random>
+#include <thread>
+#include <vector>
+
+struct AirPlayHarness
+{
+  static auto connect(AirPlay &a) -> void { AirPlay::conn_init(&a); }
+  static auto disconnect(AirPlay &a) -> void { AirPlay::conn_destroy(&a); }
+  static auto flush(AirPlay &a) -> void { AirPlay::video_flush(&a); }
+  static auto render(AirPlay &a, h264_decode_struct *pkt) -> void { a.render(pkt); }
+  static auto restart(AirPlay &a) -> void
+  {
+    a.restart_server_with_settings(a.current_server_name, a.current_use_random_mac);
+  }
+  static auto session(const AirPlay &a) -> Session::Snapshot { return a.session.load(); }
+};
+
+static std::atomic<int> failures = 0;
+
+static auto check(bool ok, const char *what) -> void
+{
+  if (ok)
+    return;
+  if (failures++ < 10)
+    fprintf(stderr, "FAILED: %s\n", what);
+}
+
+// holds in every snapshot, whatever runs concurrently
+static auto consistent(Session::Snapshot s) -> bool
+{
+  return (s.state != SessionState::idle || s.connections == 0) &&
+         (s.state != SessionState::connected || s.connections > 0);
+}
+
+// The packets of a recording, or a few made-up NAL units the decoder rejects, which still takes
+// render() through the stats, the decoder lock and the resync
+static auto packets(const char *path) -> std::vector<std::vector<uint8_t>>
+{
+  std::vector<uint8_t> stream;
+  if (path)
+  {
+    std::ifstream file(path, std::ios::binary);
+    stream.assign(std::istreambuf_iterator<char>(file), {});
+  }
+  if (stream.empty())
+    stream = {0, 0, 0, 1, 0x67, 0x42, 0xc0, 0x1f, 0, 0, 0, 1, 0x68, 0xce, 0x3c, 0x80,
+              0, 0, 0, 1, 0x65, 0x88, 0x84, 0x21, 0, 0, 0, 1, 0x41, 0x9a, 0x02, 0x04};
+  std::vector<std::vector<uint8_t>> ret;
+  forEachNal(stream, [&](std::span<const uint8_t> nal) {
+    ret.push_back({0, 0, 0, 1});
+    ret.back().insert(ret.back().end(), nal.begin(), nal.end());
+  });
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  const auto devices = 4;
+  const auto cycles = argc > 1 ? atoi(argv[1]) : 2000;
+  const auto restarts = argc > 2 ? atoi(argv[2]) : 50;
+  auto stream = packets(argc > 3 ? argv[3] : nullptr);
+
+  auto data = obs_data_create();
+  obs_data_set_string(data, "server_name", "airplay-stress");
+  obs_data_set_bool(data, "use_random_mac", true);
+  obs_data_set_int(data, "network_port", 0);
+  {
+    AirPlay airPlay(data, nullptr);
+    check(AirPlayHarness::session(airPlay).state == SessionState::idle, "idle after start");
+
+    // Without restarts a device always finds its own connection counted and the session
+    // connected, however the other devices interleave
+    {
+      std::vector<std::thread> threads;
+      for (auto d = 0; d < devices; ++d)
+        threads.emplace_back([&, d]() {
+          std::mt19937 rng(d);
+          for (auto i = 0; i < cycles; ++i)
+          {
+            AirPlayHarness::connect(airPlay);
+            const auto s = AirPlayHarness::session(airPlay);
+            check(s.state == SessionState::connected && s.connections > 0,
+                  "connected after conn_init");
+            std::this_thread::sleep_for(std::chrono::microseconds(rng() % 50));
+            AirPlayHarness::disconnect(airPlay);
+          }
+        });
+      for (auto &t : threads)
+        t.join();
+      const auto s = AirPlayHarness::session(airPlay);
+      check(s.state == SessionState::idle && s.connections == 0, "idle after the last disconnect");
+    }
+
+    // Connects, disconnects, restarts and packets all at once. A restart drops the connections it
+    // finds, their late disconnects must not drive the count below 0.
+    {
+      std::atomic<bool> done = false;
+      std::vector<std::thread> threads;
+      for (auto d = 0; d < devices; ++d)
+        threads.emplace_back([&, d]() {
+          std::mt19937 rng(d + devices);
+          for (auto i = 0; i < cycles; ++i)
+          {
+            AirPlayHarness::connect(airPlay);
+            std::this_thread::sleep_for(std::chrono::microseconds(rng() % 50));
+            if (rng() % 16 == 0)
+              AirPlayHarness::flush(airPlay);
+            AirPlayHarness::disconnect(airPlay);
+          }
+        });
+      const auto workers = threads.size();
+      threads.emplace_back([&]() {
+        for (auto i = 0; i < restarts && !done; ++i)
+        {
+          AirPlayHarness::restart(airPlay);
+          std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+      });
+      threads.emplace_back([&]() {
+        auto pts = uint64_t{0};
+        for (auto i = size_t{0}; !done; ++i)
+        {
+          auto &p = stream[i % stream.size()];
+          h264_decode_struct pkt = {};
+          pkt.data = p.data();
+          pkt.data_len = static_cast<int>(p.size());
+          pkt.pts = pts += 16'667;
+          AirPlayHarness::render(airPlay, &pkt);
+        }
+      });
+      threads.emplace_back([&]() {
+        while (!done)
+          check(consistent(AirPlayHarness::session(airPlay)), "session state matches the count");
+      });
+      for (auto i = 0U; i < workers; ++i)
+        threads[i].join();
+      threads[workers].join();
+      done = true;
+      for (auto i = workers + 1; i < threads.size(); ++i)
+        threads[i].join();
+      const auto s = AirPlayHarness::session(airPlay);
+      check(s.state == SessionState::idle && s.connections == 0,
+            "idle with no connections once every device disconnected");
+    }
+
+    // a device connecting while the restarted server is still starting up keeps its session
+    for (auto i = 0; i < restarts; ++i)
+    {
+      std::atomic<bool> restarting = true;
+      std::thread device([&]() {
+        while (AirPlayHarness::session(airPlay).state != SessionState::restarting && restarting)
+          std::this_thread::yield();
+        while (AirPlayHarness::session(airPlay).state == SessionState::restarting && restarting)
+          std::this_thread::yield();
+        AirPlayHarness::connect(airPlay);
+      });
+      AirPlayHarness::restart(airPlay);
+      restarting = false;
+      device.join();
+      check(AirPlayHarness::session(airPlay).state == SessionState::connected,
+            "connected when conn_init races the server start");
+      AirPlayHarness::disconnect(airPlay);
+    }
+  }
+  obs_data_release(data);
+
+  if (failures)
+  {
+    fprintf(stderr, "%d failures\n", failures.load());
+    return 1;
+  }
+  printf("ok: %d devices x %d cycles, %d restarts\n", devices, cycles, restarts);
+  return 0;
+}
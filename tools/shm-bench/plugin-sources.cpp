@@ -0,0 +1 @@
+#include "../../shm-frame-ring.cpp"
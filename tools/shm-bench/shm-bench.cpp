@@ -0,0 +1,136 @@
+// Throughput and latency of the shared-memory frame ring. The writer and the reader run in two
+// processes like OBS and a consumer would. Throughput is measured with the writer running flat
+// out, latency at a 60 fps cadence from write() to the reader's next() returning, using the
+// steady clock timestamps the writer stores in the frames.
+#include "../../shm-frame-ring.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+constexpr auto Yuv420p = 0; // AV_PIX_FMT_YUV420P
+
+static auto now() -> uint64_t
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+}
+
+// 4:2:0 picture of width x height, the plane contents do not matter for the copy
+struct Picture
+{
+  Picture(int width, int height)
+    : width(width), height(height), y(width * height, 16), u(width * height / 4, 128),
+      v(width * height / 4, 128)
+  {
+  }
+
+  auto planes() const -> std::vector<ShmPlane>
+  {
+    return {{y.data(), width, height},
+            {u.data(), width / 2, height / 2},
+            {v.data(), width / 2, height / 2}};
+  }
+
+  auto bytes() const -> size_t { return y.size() + u.size() + v.size(); }
+
+  int width;
+  int height;
+  std::vector<uint8_t> y;
+  std::vector<uint8_t> u;
+  std::vector<uint8_t> v;
+};
+
+// Reads until the writer closes the segment or nothing arrives for a second, prints the latency
+// percentiles of the frames received
+static auto reader(const std::string &name, bool latency) -> int
+{
+  ShmFrameReader r(name);
+  std::vector<uint64_t> latencies;
+  auto frames = 0;
+  while (const auto f = r.next(1s))
+  {
+    const auto t = now();
+    if (!r.valid(*f))
+      continue;
+    ++frames;
+    if (latency)
+      latencies.push_back(t - f->timestamp);
+  }
+  printf("  reader: %d frames, %llu dropped\n",
+         frames,
+         static_cast<unsigned long long>(r.dropped()));
+  if (latencies.empty())
+    return 0;
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double p) {
+    return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))] /
+           1000.0;
+  };
+  printf("  latency us: p50 %.1f, p90 %.1f, p99 %.1f, max %.1f\n",
+         percentile(0.5),
+         percentile(0.9),
+         percentile(0.99),
+         latencies.back() / 1000.0);
+  return 0;
+}
+
+static auto run(const char *what, const Picture &picture, int frames, bool paced) -> void
+{
+  const auto name = "/obs-airplay-bench-" + std::to_string(getpid());
+  printf("%s, %dx%d, %d frames\n", what, picture.width, picture.height, frames);
+  std::optional<ShmFrameWriter> writer(std::in_place, name);
+  const auto planes = picture.planes();
+  // the segment exists before the reader starts, so it sees every frame from the first one
+  writer->write(picture.width, picture.height, Yuv420p, planes, now(), 0);
+  fflush(stdout);
+  const auto child = fork();
+  if (child == 0)
+  {
+    const auto ret = reader(name, paced);
+    fflush(stdout);
+    _exit(ret);
+  }
+  std::this_thread::sleep_for(100ms);
+
+  const auto start = now();
+  for (auto i = 1; i <= frames; ++i)
+  {
+    if (paced)
+      std::this_thread::sleep_until(std::chrono::steady_clock::time_point(
+        std::chrono::nanoseconds(start + i * 1'000'000'000ULL / 60)));
+    if (!writer->write(picture.width, picture.height, Yuv420p, planes, now(), i))
+    {
+      perror("write");
+      break;
+    }
+  }
+  const auto seconds = (now() - start) / 1e9;
+  if (!paced)
+    printf("  writer: %.0f frames/s, %.2f GB/s\n",
+           frames / seconds,
+           frames * picture.bytes() / seconds / 1e9);
+  // closing the segment ends the reader
+  writer.reset();
+  waitpid(child, nullptr, 0);
+}
+
+int main(int argc, char **argv)
+{
+  const auto frames = argc > 1 ? atoi(argv[1]) : 2000;
+  for (const auto &picture : {Picture(1920, 1080), Picture(3840, 2160)})
+  {
+    run("throughput", picture, frames, false);
+    run("latency at 60 fps", picture, std::min(frames, 600), true);
+  }
+  return 0;
+}
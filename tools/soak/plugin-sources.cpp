@@ -0,0 +1 @@
+#include "../plugin-sources.inc"
@@ -0,0 +1,153 @@
+// Soak test for leaks across sessions. Replays a recorded Annex B stream through VideoDecoder
+// instances that are created, flushed, released and destroyed, then cycles AirPlay servers
+// through connections, decoder flushes, restarts and destruction. Resource usage is sampled once
+// the warm-up cycles have filled the allocator caches and again at the end of each phase, the test
+// exits with 1 when RSS grew past the tolerance or any file descriptor or thread was left behind.
+// Needs a running mDNS responder for the raop server.
+#include "../../airplay.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <obs/obs.h>
+#include <span>
+#include <vector>
+
+struct AirPlayHarness
+{
+  static auto connect(AirPlay &a) -> void { AirPlay::conn_init(&a); }
+  static auto disconnect(AirPlay &a) -> void { AirPlay::conn_destroy(&a); }
+  static auto flush(AirPlay &a) -> void { AirPlay::video_flush(&a); }
+  static auto restart(AirPlay &a) -> void
+  {
+    a.restart_server_with_settings(a.current_server_name, a.current_use_random_mac);
+  }
+  static auto decode(AirPlay &a, std::span<const uint8_t> data) -> void
+  {
+    std::lock_guard<std::mutex> lock(a.vDecoderMutex);
+    a.vDecoder.decode(data);
+  }
+  static auto release(AirPlay &a) -> void
+  {
+    std::lock_guard<std::mutex> lock(a.vDecoderMutex);
+    a.vDecoder.release();
+  }
+};
+
+static auto failures = 0;
+
+static auto print(const char *what, const ResourceUsage &u) -> void
+{
+  printf("%-22s RSS %6.1f MiB, %d fds, %d threads\n", what, u.rss / 1048576.0, u.fds, u.threads);
+}
+
+// Runs cycles of f, the first warmup of them before the baseline is taken
+template <typename F>
+static auto phase(const char *name, int cycles, long rssTolerance, F f) -> void
+{
+  const auto warmup = std::max(cycles / 10, 1);
+  for (auto i = 0; i < warmup; ++i)
+    f(i);
+  const auto baseline = resourceUsage();
+  printf("%s\n", name);
+  print("  after warm-up", baseline);
+  for (auto i = warmup; i < cycles; ++i)
+  {
+    f(i);
+    if ((i + 1) % std::max(cycles / 4, 1) == 0)
+    {
+      char what[32];
+      snprintf(what, sizeof(what), "  after %d cycles", i + 1);
+      print(what, resourceUsage());
+    }
+  }
+  const auto end = resourceUsage();
+  auto check = [&](bool ok, const char *what) {
+    if (ok)
+      return;
+    fprintf(stderr, "FAILED: %s: %s\n", name, what);
+    ++failures;
+  };
+  check(end.rss <= baseline.rss + rssTolerance, "resident set size grew past the tolerance");
+  check(end.fds <= baseline.fds, "file descriptors were left open");
+  check(end.threads <= baseline.threads, "threads were left running");
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    fprintf(stderr,
+            "usage: %s <recording.h264|.hevc> [cycles (2000)] [RSS tolerance in MiB (8)]\n",
+            argv[0]);
+    return 2;
+  }
+  std::ifstream file(argv[1], std::ios::binary);
+  const auto stream = std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {});
+  const auto units = accessUnits(stream);
+  if (units.empty())
+  {
+    fprintf(stderr, "%s: no NAL units found\n", argv[1]);
+    return 2;
+  }
+  const auto cycles = argc > 2 ? atoi(argv[2]) : 2000;
+  const auto rssTolerance = (argc > 3 ? atol(argv[3]) : 8) * 1048576;
+  auto replay = [&](auto decode, size_t from, size_t to) {
+    for (auto i = from; i < std::min(to, units.size()); ++i)
+      decode(std::span<const uint8_t>{units[i]});
+  };
+
+  // every cycle a new decoder, flushed mid-stream, released and restarted on the replay
+  phase("VideoDecoder create/flush/release/destroy", cycles, rssTolerance, [&](int) {
+    VideoDecoder decoder;
+    auto decode = [&](std::span<const uint8_t> data) { decoder.decode(data); };
+    replay(decode, 0, units.size() / 2);
+    decoder.flush();
+    replay(decode, 0, units.size());
+    decoder.release();
+    replay(decode, 0, units.size());
+  });
+
+  auto data = obs_data_create();
+  obs_data_set_string(data, "server_name", "airplay-soak");
+  obs_data_set_bool(data, "use_random_mac", true);
+  obs_data_set_int(data, "network_port", 0);
+
+  // sessions on a long-running server, restarted every 10th cycle
+  {
+    AirPlay airPlay(data, nullptr);
+    phase("AirPlay sessions and restarts", cycles, rssTolerance, [&](int i) {
+      auto decode = [&](std::span<const uint8_t> packet) {
+        AirPlayHarness::decode(airPlay, packet);
+      };
+      AirPlayHarness::connect(airPlay);
+      replay(decode, 0, units.size());
+      AirPlayHarness::flush(airPlay);
+      replay(decode, 0, units.size());
+      AirPlayHarness::disconnect(airPlay);
+      AirPlayHarness::release(airPlay);
+      if (i % 10 == 9)
+        AirPlayHarness::restart(airPlay);
+    });
+  }
+
+  // servers created and destroyed, starting and stopping the raop and mDNS threads each time
+  phase("AirPlay create/destroy", std::max(cycles / 10, 10), rssTolerance, [&](int) {
+    AirPlay airPlay(data, nullptr);
+    AirPlayHarness::connect(airPlay);
+    replay([&](std::span<const uint8_t> packet) { AirPlayHarness::decode(airPlay, packet); },
+           0,
+           units.size());
+    AirPlayHarness::disconnect(airPlay);
+  });
+  obs_data_release(data);
+
+  if (failures)
+  {
+    fprintf(stderr, "%d failures\n", failures);
+    return 1;
+  }
+  printf("ok: no growth over %d cycles\n", cycles);
+  return 0;
+}
@@ -0,0 +1,95 @@
+#include "udp-sockets.hpp"
+#include "async-log.hpp"
+#include "resource-usage.hpp"
+#include <algorithm>
+#include <fstream>
+#include <netinet/in.h>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static auto localPort(int fd) -> int
+{
+  sockaddr_storage addr;
+  socklen_t len = sizeof(addr);
+  if (getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &len) != 0)
+    return -1;
+  switch (addr.ss_family)
+  {
+  case AF_INET: return ntohs(reinterpret_cast<sockaddr_in *>(&addr)->sin_port);
+  case AF_INET6: return ntohs(reinterpret_cast<sockaddr_in6 *>(&addr)->sin6_port);
+  }
+  return -1;
+}
+
+auto setUdpReceiveBuffer(std::span<const unsigned short> ports, int size) -> int
+{
+  auto changed = 0;
+  for (const auto fd : openFileDescriptors())
+  {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISSOCK(st.st_mode))
+      continue;
+    int type = 0;
+    socklen_t len = sizeof(type);
+    if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) != 0 || type != SOCK_DGRAM)
+      continue;
+    const auto port = localPort(fd);
+    if (port <= 0 || std::find(ports.begin(), ports.end(), port) == ports.end())
+      continue;
+#ifdef SO_RCVBUFFORCE
+    // goes past net.core.rmem_max when OBS runs with CAP_NET_ADMIN
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) != 0)
+#endif
+      if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) != 0)
+      {
+        ALOG(session, warning, "setsockopt(SO_RCVBUF) failed for UDP port", port);
+        continue;
+      }
+    int actual = 0;
+    len = sizeof(actual);
+    getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &actual, &len);
+    ALOG(session, info, "UDP port", port, "receive buffer", actual, "bytes, requested", size);
+    ++changed;
+  }
+  return changed;
+}
+
+auto udpSocketStats(std::span<const unsigned short> ports) -> std::vector<UdpSocketStats>
+{
+  std::vector<UdpSocketStats> ret;
+#ifdef __linux__
+  for (const auto path : {"/proc/net/udp", "/proc/net/udp6"})
+  {
+    std::ifstream f(path);
+    std::string line;
+    std::getline(f, line); // header
+    while (std::getline(f, line))
+    {
+      // sl local_address rem_address st tx_queue:rx_queue tr:tm->when retrnsmt uid timeout inode
+      // ref pointer drops
+      std::istringstream ss(line);
+      std::string sl, local, remote, st, queues, timer, retrnsmt, uid, timeout, inode, ref, ptr;
+      long drops = 0;
+      if (!(ss >> sl >> local >> remote >> st >> queues >> timer >> retrnsmt >> uid >> timeout >>
+            inode >> ref >> ptr >> drops))
+        continue;
+      const auto colon = local.rfind(':');
+      if (colon == std::string::npos)
+        continue;
+      const auto port = static_cast<unsigned short>(std::stoul(local.substr(colon + 1), nullptr, 16));
+      if (std::find(ports.begin(), ports.end(), port) == ports.end())
+        continue;
+      const auto queueColon = queues.find(':');
+      const auto rxQueue =
+        queueColon == std::string::npos ? 0 : std::stol(queues.substr(queueColon + 1), nullptr, 16);
+      ret.push_back({port, rxQueue, drops});
+    }
+  }
+#else
+  (void)ports;
+#endif
+  return ret;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <span>
+#include <vector>
+
+struct UdpSocketStats
+{
+  unsigned short port;
+  long rxQueue; // bytes waiting in the receive buffer
+  long drops;   // datagrams dropped by the kernel because the receive buffer was full
+};
+
+// The RAOP audio, control and timing sockets are owned by the raop library, they are found by the
+// local port they are bound to.
+
+// Sets SO_RCVBUF on the UDP sockets of this process bound to one of the ports, returns the number
+// of sockets changed.
+auto setUdpReceiveBuffer(std::span<const unsigned short> ports, int size) -> int;
+// Kernel counters of the UDP sockets bound to one of the ports, empty where the OS does not
+// provide them.
+auto udpSocketStats(std::span<const unsigned short> ports) -> std::vector<UdpSocketStats>;
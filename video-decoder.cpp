@@ -0,0 +1,464 @@
+#include "video-decoder.hpp"
+#include "async-log.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+VideoDecoder::VideoDecoder()
+  : codec(avcodec_find_decoder(AV_CODEC_ID_H264)),
+    yuvPicture(av_frame_alloc()),
+    receivedPicture(av_frame_alloc()),
+    rgbPicture(av_frame_alloc()),
+    pkt(av_packet_alloc()),
+    input(AV_INPUT_BUFFER_PADDING_SIZE)
+{
+  if (!codec)
+  {
+    throw std::runtime_error("VideoDecoder: avcodec_find_decoder failed");
+  }
+  if (!openCodec())
+  {
+    throw std::runtime_error("VideoDecoder: avcodec_open2 failed");
+  }
+}
+
+auto VideoDecoder::openCodec() -> bool
+{
+  ctx = avcodec_alloc_context3(codec);
+  if (!ctx)
+    return false;
+  if (avcodec_open2(ctx, codec, NULL) < 0)
+  {
+    avcodec_free_context(&ctx);
+    return false;
+  }
+  return true;
+}
+
+auto VideoDecoder::setCodec(VideoCodec value) -> bool
+{
+  const auto id = value == VideoCodec::hevc ? AV_CODEC_ID_HEVC : AV_CODEC_ID_H264;
+  auto c = avcodec_find_decoder(id);
+  if (!c)
+  {
+    ALOG(video, error, "VideoDecoder: no decoder for", value == VideoCodec::hevc ? "HEVC" : "H.264");
+    return false;
+  }
+  avcodec_free_context(&ctx);
+  codec = c;
+  videoCodec = value;
+  vps.clear();
+  sps.clear();
+  pps.clear();
+  ALOG(video, info, "Video codec:", value == VideoCodec::hevc ? "HEVC" : "H.264");
+  return openCodec();
+}
+
+auto VideoDecoder::release() -> void
+{
+  avcodec_free_context(&ctx);
+  av_frame_unref(yuvPicture);
+  if (swsContext)
+    sws_freeContext(swsContext);
+  swsContext = nullptr;
+  lastWidth = 0;
+  lastHeight = 0;
+  lastFormat = -1;
+  lastHash = 0;
+  prewarm = Prewarm::none;
+  pendingPicture = false;
+  pendingUnchanged = false;
+  std::vector<Plane>().swap(frame.planes);
+  std::vector<uint8_t>().swap(resyncPacket);
+  input.clear();
+  waitingForIdr = false;
+  resyncing = false;
+}
+
+VideoDecoder::~VideoDecoder()
+{
+  avcodec_free_context(&ctx);
+  av_frame_free(&yuvPicture);
+  av_frame_free(&receivedPicture);
+  av_frame_free(&rgbPicture);
+  av_packet_free(&pkt);
+  if (swsContext)
+    sws_freeContext(swsContext);
+}
+
+auto VideoDecoder::flush() -> void
+{
+  flushRequested = true;
+}
+
+auto VideoDecoder::resync(std::span<const uint8_t> data) -> std::span<const uint8_t>
+{
+  if (flushRequested.exchange(false))
+  {
+    avcodec_flush_buffers(ctx);
+    waitingForIdr = true;
+    resyncing = true;
+    flushTime = std::chrono::steady_clock::now();
+  }
+
+  auto first = true;
+  auto hasIdr = false;
+  auto hasVps = false;
+  auto hasSps = false;
+  auto hasPps = false;
+  forEachNal(data, [&](std::span<const uint8_t> nal) {
+    if (first && nal.size() >= 2)
+    {
+      first = false;
+      const auto detected = detectCodec(nal[0], nal[1]);
+      if (detected && *detected != videoCodec)
+        setCodec(*detected);
+    }
+    switch (classify(videoCodec, nal[0]))
+    {
+    case Nal::idr: hasIdr = true; break;
+    case Nal::vps:
+      hasVps = true;
+      vps.assign(nal.begin(), nal.end());
+      break;
+    case Nal::sps:
+      hasSps = true;
+      sps.assign(nal.begin(), nal.end());
+      break;
+    case Nal::pps:
+      hasPps = true;
+      pps.assign(nal.begin(), nal.end());
+      break;
+    case Nal::slice:
+    case Nal::other: break;
+    }
+  });
+
+  if (!waitingForIdr)
+    return data;
+  if (!hasIdr)
+    return {};
+  waitingForIdr = false;
+  const auto needsVps = videoCodec == VideoCodec::hevc;
+  if ((hasSps && hasPps && (hasVps || !needsVps)) || sps.empty() || pps.empty() ||
+      (needsVps && vps.empty()))
+    return data;
+
+  // the IDR frame came without parameter sets, prepend the cached ones
+  static const uint8_t startCode[] = {0, 0, 0, 1};
+  resyncPacket.clear();
+  if (needsVps)
+  {
+    resyncPacket.insert(resyncPacket.end(), std::begin(startCode), std::end(startCode));
+    resyncPacket.insert(resyncPacket.end(), vps.begin(), vps.end());
+  }
+  resyncPacket.insert(resyncPacket.end(), std::begin(startCode), std::end(startCode));
+  resyncPacket.insert(resyncPacket.end(), sps.begin(), sps.end());
+  resyncPacket.insert(resyncPacket.end(), std::begin(startCode), std::end(startCode));
+  resyncPacket.insert(resyncPacket.end(), pps.begin(), pps.end());
+  resyncPacket.insert(resyncPacket.end(), data.begin(), data.end());
+  const auto size = resyncPacket.size();
+  resyncPacket.resize(size + AV_INPUT_BUFFER_PADDING_SIZE, 0);
+  return {resyncPacket.data(), size};
+}
+
+// Every 4th row of every plane is hashed, that catches a moving cursor or typed text while
+// reading a quarter of the picture, a fraction of what the RGBA conversion costs.
+auto VideoDecoder::pictureHash() const -> uint64_t
+{
+  constexpr auto RowStep = 4;
+  const auto format = static_cast<AVPixelFormat>(yuvPicture->format);
+  const auto desc = av_pix_fmt_desc_get(format);
+  int rowBytes[4];
+  if (!desc || av_image_fill_linesizes(rowBytes, format, yuvPicture->width) < 0)
+    return 0;
+  auto h = uint64_t{14695981039346656037ULL};
+  auto mix = [&h](uint64_t v) { h = (h ^ v) * 1099511628211ULL; };
+  mix(yuvPicture->width);
+  mix(yuvPicture->height);
+  mix(yuvPicture->format);
+  for (auto p = 0; p < 4 && yuvPicture->data[p]; ++p)
+  {
+    const auto height =
+      p == 0 ? yuvPicture->height : AV_CEIL_RSHIFT(yuvPicture->height, desc->log2_chroma_h);
+    for (auto y = 0; y < height; y += RowStep)
+    {
+      const auto row = yuvPicture->data[p] + y * yuvPicture->linesize[p];
+      auto x = 0;
+      for (; x + 8 <= rowBytes[p]; x += 8)
+      {
+        uint64_t v;
+        memcpy(&v, row + x, sizeof(v));
+        mix(v);
+      }
+      for (; x < rowBytes[p]; ++x)
+        mix(row[x]);
+    }
+  }
+  return h;
+}
+
+auto VideoDecoder::setMaxOutputSize(int width, int height) -> void
+{
+  maxWidth = width;
+  maxHeight = height;
+}
+
+// Largest size with the picture's aspect ratio that fits into maxWidth x maxHeight, pictures are
+// never scaled up
+static auto fitOutputSize(int width, int height, int maxWidth, int maxHeight)
+  -> std::pair<int, int>
+{
+  if (maxWidth <= 0 || maxHeight <= 0 || (width <= maxWidth && height <= maxHeight))
+    return {width, height};
+  const auto scale = std::min(static_cast<double>(maxWidth) / width,
+                              static_cast<double>(maxHeight) / height);
+  // even sizes keep chroma subsampled planes aligned if OBS converts the frame further
+  return {std::max(2, static_cast<int>(width * scale) & ~1),
+          std::max(2, static_cast<int>(height * scale) & ~1)};
+}
+
+auto VideoDecoder::picture() const -> YuvPicture
+{
+  YuvPicture ret = {};
+  ret.width = yuvPicture->width;
+  ret.height = yuvPicture->height;
+  ret.format = yuvPicture->format;
+  const auto desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(yuvPicture->format));
+  for (auto p = 0; p < 4 && desc && yuvPicture->data[p]; ++p)
+  {
+    ret.data[p] = yuvPicture->data[p];
+    ret.linesize[p] = yuvPicture->linesize[p];
+    ret.rows[p] = p == 0 || p == 3 ? yuvPicture->height
+                                   : AV_CEIL_RSHIFT(yuvPicture->height, desc->log2_chroma_h);
+    ret.planes = p + 1;
+  }
+  return ret;
+}
+
+// Recreates the conversion context and the RGBA plane when the picture size, its format or the
+// output size change
+auto VideoDecoder::setupConversion(int width, int height, int format) -> bool
+{
+  const auto [dstWidth, dstHeight] = fitOutputSize(width, height, maxWidth, maxHeight);
+  if (swsContext && width == lastWidth && height == lastHeight && format == lastFormat &&
+      dstWidth == rgbPicture->width && dstHeight == rgbPicture->height)
+    return true;
+  if (swsContext)
+    sws_freeContext(swsContext);
+
+  // downscaling happens in the same pass as the colour conversion, area averaging avoids the
+  // aliasing fast bilinear shows on text when shrinking
+  const auto scaling = dstWidth != width || dstHeight != height;
+  swsContext = sws_getContext(width,
+                              height,
+                              static_cast<AVPixelFormat>(format),
+                              dstWidth,
+                              dstHeight,
+                              AV_PIX_FMT_RGBA,
+                              scaling ? SWS_AREA : SWS_FAST_BILINEAR,
+                              NULL,
+                              NULL,
+                              NULL);
+  if (!swsContext)
+  {
+    ALOG(video, error, "VideoDecoder: sws_getContext failed");
+    lastWidth = 0;
+    lastHeight = 0;
+    return false;
+  }
+
+  // swscale writes straight into the plane handed to OBS, no intermediate buffer
+  frame.planes.resize(1);
+  frame.planes[0].data.resize(av_image_get_buffer_size(AV_PIX_FMT_RGBA, dstWidth, dstHeight, 1));
+  av_image_fill_arrays(rgbPicture->data,
+                       rgbPicture->linesize,
+                       frame.planes[0].data.data(),
+                       AV_PIX_FMT_RGBA,
+                       dstWidth,
+                       dstHeight,
+                       1);
+  frame.planes[0].linesize = rgbPicture->linesize[0];
+  rgbPicture->width = dstWidth;
+  rgbPicture->height = dstHeight;
+  if (scaling)
+    ALOG(video, info, "Scaling", width, "x", height, "down to", dstWidth, "x", dstHeight);
+  lastWidth = width;
+  lastHeight = height;
+  lastFormat = format;
+  return true;
+}
+
+auto VideoDecoder::prepare(int width, int height) -> void
+{
+  if (!ctx && !openCodec())
+  {
+    ALOG(video, error, "VideoDecoder: avcodec_open2 failed");
+    return;
+  }
+  prewarm = Prewarm::none;
+  if (width <= 0 || height <= 0)
+    return;
+  // the software H.264 and HEVC decoders output 4:2:0 for mirroring streams, the SPS that would
+  // tell for sure has not arrived yet. Whether the guess held is checked on the first picture.
+  prewarm = setupConversion(width, height, AV_PIX_FMT_YUV420P) ? Prewarm::pending : Prewarm::none;
+}
+
+auto VideoDecoder::decode(std::span<const uint8_t> data, bool convert) -> const VFrame *
+{
+  if (!ctx && !openCodec())
+  {
+    ALOG(video, error, "VideoDecoder: avcodec_open2 failed");
+    return nullptr;
+  }
+  // a newer packet supersedes the held back picture, the next receive overwrites it anyway
+  pendingPicture = false;
+  pendingUnchanged = false;
+  newPicture = false;
+  data = resync(data);
+  if (data.empty() || !ctx)
+    return nullptr;
+  // the resync packet is padded already
+  if (data.data() != resyncPacket.data())
+    data = input.assign(data);
+
+  pkt->data = const_cast<uint8_t *>(data.data());
+  pkt->size = data.size();
+
+  // send before receive, so the picture of this packet comes out of this call instead of the
+  // next one
+  auto received = false;
+  auto result = avcodec_send_packet(ctx, pkt);
+  if (result == AVERROR(EAGAIN))
+  {
+    // pictures are still queued in the decoder, they are taken out to make room for the packet
+    received = receivePictures();
+    result = avcodec_send_packet(ctx, pkt);
+  }
+  if (result < 0 && !received)
+    return nullptr;
+  if (result >= 0)
+    received = receivePictures() || received;
+  if (!received || yuvPicture->linesize[0] == 0)
+    return nullptr;
+  newPicture = true;
+  if (!convert)
+  {
+    pendingPicture = true;
+    return nullptr;
+  }
+
+  const auto [dstWidth, dstHeight] =
+    fitOutputSize(yuvPicture->width, yuvPicture->height, maxWidth, maxHeight);
+
+  // static screens: skip conversion and output, the picture stays pending so the caller can
+  // refresh it in case a change fell between the sampled rows
+  const auto hash = pictureHash();
+  if (hash && hash == lastHash && yuvPicture->width == lastWidth &&
+      yuvPicture->height == lastHeight && dstWidth == rgbPicture->width &&
+      dstHeight == rgbPicture->height)
+  {
+    unchanged.fetch_add(1, std::memory_order_relaxed);
+    pendingPicture = true;
+    pendingUnchanged = true;
+    return nullptr;
+  }
+  lastHash = hash;
+  return convertPicture();
+}
+
+// Takes every picture the decoder has ready, only the newest is kept in yuvPicture. Returns false
+// if there was none, yuvPicture then still holds the previous one.
+auto VideoDecoder::receivePictures() -> bool
+{
+  auto ret = false;
+  while (avcodec_receive_frame(ctx, receivedPicture) == 0)
+  {
+    av_frame_unref(yuvPicture);
+    av_frame_move_ref(yuvPicture, receivedPicture);
+    ret = true;
+  }
+  return ret;
+}
+
+static auto formatName(int format) -> const char *
+{
+  const auto name = av_get_pix_fmt_name(static_cast<AVPixelFormat>(format));
+  return name ? name : "unknown format";
+}
+
+auto VideoDecoder::pending() const -> bool
+{
+  return pendingPicture && !flushRequested;
+}
+
+auto VideoDecoder::convertPending() -> const VFrame *
+{
+  if (!pending())
+    return nullptr;
+  // converted after all, it no longer counts as skipped
+  if (pendingUnchanged)
+    unchanged.fetch_sub(1, std::memory_order_relaxed);
+  pendingPicture = false;
+  pendingUnchanged = false;
+  lastHash = pictureHash();
+  return convertPicture();
+}
+
+auto VideoDecoder::convertPicture() -> const VFrame *
+{
+  if (prewarm == Prewarm::pending)
+  {
+    const auto hit = yuvPicture->width == lastWidth && yuvPicture->height == lastHeight &&
+                     yuvPicture->format == lastFormat;
+    prewarm = hit ? Prewarm::hit : Prewarm::missed;
+    if (!hit)
+      ALOG(video,
+           info,
+           "Conversion set up again, it was prepared for",
+           lastWidth,
+           "x",
+           lastHeight,
+           formatName(lastFormat),
+           "and the first picture is",
+           yuvPicture->width,
+           "x",
+           yuvPicture->height,
+           formatName(yuvPicture->format));
+  }
+  if (!setupConversion(yuvPicture->width, yuvPicture->height, yuvPicture->format))
+    return nullptr;
+
+  sws_scale(swsContext,
+            yuvPicture->data,
+            yuvPicture->linesize,
+            0,
+            yuvPicture->height,
+            rgbPicture->data,
+            rgbPicture->linesize);
+
+  frame.width = rgbPicture->width;
+  frame.height = rgbPicture->height;
+  frame.format = VIDEO_FORMAT_RGBA;
+  if (resyncing)
+  {
+    resyncing = false;
+    ALOG(video,
+         info,
+         "First frame after flush in",
+         std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                                                               flushTime)
+           .count(),
+         "ms");
+  }
+  return &frame;
+}
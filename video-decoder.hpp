@@ -0,0 +1,116 @@
+#pragma once
+#include "annex-b.hpp"
+#include "packet-buffer.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <obs/obs.h>
+#include <span>
+#include <vector>
+
+struct Plane
+{
+  std::vector<uint8_t> data;
+  int linesize;
+};
+
+struct VFrame
+{
+  std::vector<Plane> planes;
+  int width;
+  int height;
+  video_format format;
+};
+
+// Decoded picture as it left the decoder, the pointers stay valid until the next decode() call
+struct YuvPicture
+{
+  int width;
+  int height;
+  int format; // AVPixelFormat
+  int planes;
+  std::array<const uint8_t *, 4> data;
+  std::array<int, 4> linesize;
+  std::array<int, 4> rows;
+};
+
+// Decodes an Annex B H.264 or HEVC mirroring stream to RGBA. The codec is taken from the parameter
+// sets in the stream, the decoder starts out with H.264.
+class VideoDecoder
+{
+public:
+  VideoDecoder();
+  ~VideoDecoder();
+  // With convert false the packet only feeds the decoder, the picture is neither hashed nor
+  // converted and nullptr is returned. The picture is then pending, as is one that did not change.
+  auto decode(std::span<const uint8_t> data, bool convert = true) -> const VFrame *;
+  // True when the last decoded picture was held back by decode() and no newer packet, flush or
+  // release came since
+  auto pending() const -> bool;
+  // Converts the pending picture, changed or not. Must not run concurrently with decode().
+  auto convertPending() -> const VFrame *;
+  // Can be called from any thread, the flush is carried out by the next decode() call, which then
+  // drops packets until an IDR frame arrives.
+  auto flush() -> void;
+  // Opens the codec and sets up the RGBA conversion for a width x height 4:2:0 picture ahead of
+  // the first packet, so the first frame does not pay for it. Must not run concurrently with
+  // decode().
+  auto prepare(int width, int height) -> void;
+  // Whether the conversion set up by prepare() fit the first picture converted after it
+  enum class Prewarm { none, pending, hit, missed };
+  auto prewarmed() const -> Prewarm { return prewarm; }
+  // Frees the codec context, the conversion context and the frame planes, they are recreated by
+  // the next decode() call. Must not run concurrently with decode().
+  auto release() -> void;
+  // Picture behind the last frame decode() returned, or held back
+  auto picture() const -> YuvPicture;
+  // True when the last decode() call got a new picture from the decoder, converted or not
+  auto decodedPicture() const -> bool { return newPicture; }
+  // Frames that were decoded but not converted because the picture did not change, since the
+  // last reset
+  auto unchangedFrames() const -> uint64_t { return unchanged; }
+  auto resetUnchangedFrames() -> void { unchanged = 0; }
+  // Pictures larger than width x height are scaled down by the RGBA conversion, keeping the aspect
+  // ratio. 0 disables the limit. Can be called from any thread.
+  auto setMaxOutputSize(int width, int height) -> void;
+
+private:
+  auto openCodec() -> bool;
+  auto setCodec(VideoCodec) -> bool;
+  auto resync(std::span<const uint8_t> data) -> std::span<const uint8_t>;
+  auto pictureHash() const -> uint64_t;
+  auto setupConversion(int width, int height, int format) -> bool;
+  auto convertPicture() -> const VFrame *;
+  auto receivePictures() -> bool;
+
+  VideoCodec videoCodec = VideoCodec::h264;
+  const struct AVCodec *codec;
+  struct AVCodecContext *ctx = nullptr;
+  struct AVFrame *yuvPicture;
+  // scratch frame receivePictures() drains the decoder into
+  struct AVFrame *receivedPicture;
+  struct AVFrame *rgbPicture;
+  struct AVPacket *pkt;
+  struct SwsContext *swsContext = nullptr;
+  int lastWidth = 0;
+  int lastHeight = 0;
+  int lastFormat = -1;
+  VFrame frame;
+  std::atomic<bool> flushRequested = false;
+  bool waitingForIdr = false;
+  bool resyncing = false;
+  std::chrono::steady_clock::time_point flushTime;
+  std::vector<uint8_t> vps;
+  std::vector<uint8_t> sps;
+  std::vector<uint8_t> pps;
+  std::vector<uint8_t> resyncPacket;
+  PacketBuffer input;
+  uint64_t lastHash = 0;
+  Prewarm prewarm = Prewarm::none;
+  bool pendingPicture = false;
+  bool newPicture = false;
+  bool pendingUnchanged = false;
+  std::atomic<uint64_t> unchanged = 0;
+  std::atomic<int> maxWidth = 0;
+  std::atomic<int> maxHeight = 0;
+};